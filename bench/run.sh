@@ -0,0 +1,37 @@
+#!/bin/bash
+# Times bench/<name>.txt with scrypt and prints the best wall time of three
+# runs with the last line the script printed. Arguments starting with -- are
+# passed to scrypt, so a script can be timed with and without a pass
+# (--no-optimize, --no-bce, ...); other arguments pick the scripts to run by
+# name prefix, all of them by default.
+# usage: [SCRYPT=path to scrypt] bench/run.sh [--flag ...] [prefix ...]
+dir=$(cd "$(dirname "$0")" && pwd)
+scrypt=${SCRYPT:-$dir/../src/scrypt}
+if [ ! -x "$scrypt" ]; then
+    echo "no scrypt binary at $scrypt"
+    exit 1
+fi
+flags=()
+prefixes=()
+for arg in "$@"; do
+    if [ "${arg:0:2}" = "--" ]; then
+        flags+=("$arg")
+    else
+        prefixes+=("$arg")
+    fi
+done
+[ ${#prefixes[@]} -eq 0 ] && prefixes=("")
+TIMEFORMAT=%R
+for prefix in "${prefixes[@]}"; do
+    for input in "$dir/$prefix"*.txt; do
+        best=""
+        for run in 1 2 3; do
+            seconds=$( { time "$scrypt" "${flags[@]}" < "$input" > /tmp/bench_output.$$ 2>&1; } 2>&1 )
+            if [ -z "$best" ] || awk "BEGIN {exit !($seconds < $best)}"; then
+                best=$seconds
+            fi
+        done
+        printf "%-24s %6ss   %s\n" "$(basename "$input" .txt)" "$best" "$(tail -n 1 /tmp/bench_output.$$)"
+    done
+done
+rm -f /tmp/bench_output.$$
@@ -23,9 +23,14 @@ int main() {
                 std::cout << curr_tree->evaluate().Double << std::endl;
             } else if (curr_tree->evaluate().type_tag == "null") {
                 std::cout << "null" << std::endl;
+            } else if (curr_tree->evaluate().type_tag == "dict") {
+                ArrayNode* arr_node = new ArrayNode(0, 0, {});
+                std::cout << arr_node->evaluate_print_dict(curr_tree->evaluate()) << std::endl;
+                delete arr_node;
+                arr_node = nullptr;
             } else {
-                ArrayNode* arr_node = new ArrayNode(0, 0, curr_tree->evaluate().array);\
-                std::cout << arr_node->evaluate_print(curr_tree->evaluate().array) << std::endl;
+                ArrayNode* arr_node = new ArrayNode(0, 0, curr_tree->evaluate().elements());
+                std::cout << arr_node->evaluate_print(curr_tree->evaluate().elements()) << std::endl;
                 delete arr_node;
                 arr_node = nullptr;
             }
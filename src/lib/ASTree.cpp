@@ -1,5 +1,12 @@
 #include "ASTree.hpp"
 #include "value_bd.hpp"
+#include "Dictionary.hpp"
+#include "Collections.hpp"
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 //----------------------
 
@@ -14,38 +21,149 @@ std::string ASTNode::print(){
         return "";
     }
 
+ASTNode* ASTNode::fold(){
+        return this;
+    }
+
+bool ASTNode::evaluate_condition(std::unordered_map<std::string, value_bd>* var_map){
+        if (proven == ProvenType::Bool) {
+            return evaluate_bool(var_map);
+        }
+        value_bd value = evaluate(var_map);
+        if (value.type_tag != "bool") {
+            throw EvaluationError("condition is not a bool.");
+        }
+        return value.Bool;
+    }
+
+//----------------------
+
+// Two numbers at a time, stopping at the first pair that differs. A NaN is
+// unequal to everything, as with ==.
+static bool same_numbers(const double* a, const double* b, size_t count){
+    size_t i = 0;
+#ifdef __SSE2__
+    for (; i + 2 <= count; i += 2) {
+        if (_mm_movemask_pd(_mm_cmpeq_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i))) != 3) {
+            return false;
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        if (a[i] != b[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool same_elements(const value_bd& l, const value_bd& r){
+    size_t count = l.length();
+    if (count != r.length()) {
+        return false;
+    }
+    if (l.packed != nullptr && r.packed != nullptr) {
+        if (l.packed->flags_only != r.packed->flags_only) {
+            return count == 0;
+        }
+        if (!l.packed->flags_only) {
+            return same_numbers(l.packed->numbers.data() + l.offset, r.packed->numbers.data() + r.offset, count);
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (l.packed->flags[l.offset + i] != r.packed->flags[r.offset + i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+    // Elements of an unpacked array are compared where they are; only those
+    // of a packed one, plain numbers or bools, are made into values
+    value_bd left, right;
+    for (size_t i = 0; i < count; i++) {
+        if (l.packed != nullptr) {
+            left = l.at(i);
+        }
+        if (r.packed != nullptr) {
+            right = r.at(i);
+        }
+        if (!equal_values(l.packed != nullptr ? left : l.array[i], r.packed != nullptr ? right : r.array[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool equal_values(const value_bd& l, const value_bd& r){
+    if (l.type_tag != r.type_tag) {
+        return false;
+    }
+    if (l.type_tag == "double") {
+        return l.Double == r.Double;
+    }
+    if (l.type_tag == "bool") {
+        return l.Bool == r.Bool;
+    }
+    if (l.type_tag == "function") {
+        return l.Function_Node == r.Function_Node;
+    }
+    if (l.type_tag == "dict") {
+        return l.dict == r.dict || l.dict->same_entries(*r.dict);
+    }
+    if (l.type_tag == "heap") {
+        return l.heap == r.heap || l.heap->same_entries(*r.heap);
+    }
+    if (l.type_tag == "deque") {
+        return l.deque == r.deque || l.deque->same_entries(*r.deque);
+    }
+    if ((l.type_tag == "matrix" && l.columns != r.columns) || (l.type_tag == "record" && l.layout != r.layout)) {
+        return false;
+    }
+    if (l.type_tag == "array" || l.type_tag == "matrix" || l.type_tag == "record") {
+        return same_elements(l, r);
+    }
+    return true;    //null
+}
+
 //----------------------
 
 NumberNode::NumberNode(int line, int column, const std::string& value)
-        : ASTNode(line, column), value(value) {}
+        : ASTNode(line, column), value("double", std::stod(value)) {
+    proven = ProvenType::Double;
+    std::stringstream ss;
+    ss << this->value.Double;
+    text = ss.str();
+}
+
+NumberNode::NumberNode(int line, int column, double value, const std::string& text)
+        : ASTNode(line, column), value("double", value), text(text) {
+    proven = ProvenType::Double;
+}
 
 value_bd NumberNode::evaluate(std::unordered_map<std::string, value_bd>*){
-    return value_bd("double",std::stod(value));
+    return value;
     }
 
 std::string NumberNode::print() {
-        std::stringstream ss;
-        ss << std::stod(value);
-        std::string precision_val = ss.str();
-        return precision_val;
+        return text;
     }
 //----------------------
 
 BooleanNode::BooleanNode(int line, int column, const std::string& value)
-        : ASTNode(line, column), value(value) {}
+        : ASTNode(line, column), value("bool", value == "true"), text(value) {
+    proven = ProvenType::Bool;
+}
+
+BooleanNode::BooleanNode(int line, int column, bool value, const std::string& text)
+        : ASTNode(line, column), value("bool", value), text(text) {
+    proven = ProvenType::Bool;
+}
 
 value_bd BooleanNode::evaluate(std::unordered_map<std::string, value_bd>*){
-    double double_val = -1;
-    if(value == "false") {
-        double_val = 0;
-    } else if(value == "true") {
-        double_val = 1;
-    }
-    return value_bd("bool", double_val);
+    return value;
     }
 
 std::string BooleanNode::print() {
-        return value;
+        return text;
     }
 
 //----------------------
@@ -66,6 +184,24 @@ value_bd IdentifierNode::evaluate(std::unordered_map<std::string, value_bd>* var
     return (*var_map)[name];
 }
 
+// Only reached for names type inference proved to be assigned a number (or a
+// bool) on every path, so the map entry is read in place
+double IdentifierNode::evaluate_double(std::unordered_map<std::string, value_bd>* var_map){
+    auto found = var_map->find(name);
+    if (found == var_map->end()) {
+        return evaluate(var_map).Double;
+    }
+    return found->second.Double;
+}
+
+bool IdentifierNode::evaluate_bool(std::unordered_map<std::string, value_bd>* var_map){
+    auto found = var_map->find(name);
+    if (found == var_map->end()) {
+        return evaluate(var_map).Bool;
+    }
+    return found->second.Bool;
+}
+
 //----------------------
 
 AssignmentNode::AssignmentNode(int line, int column, ASTNode* id, ASTNode* value) : ASTNode(line, column), id(id), value(value){}
@@ -76,26 +212,13 @@ AssignmentNode::~AssignmentNode(){
 }
 
 value_bd AssignmentNode::evaluate(std::unordered_map<std::string, value_bd>* var_map){
-        if (dynamic_cast<IdentifierNode*>(id) == nullptr && dynamic_cast<ArrayNode*>(id) == nullptr) {
+        IndexNode* element = dynamic_cast<IndexNode*>(id);
+        if (dynamic_cast<IdentifierNode*>(id) == nullptr && (element == nullptr || element->name.empty())) {
             throw EvaluationError("invalid assignee.");
         }
-        if (dynamic_cast<IdentifierNode*>(id) == nullptr) {
-            ArrayNode* id_n = static_cast<ArrayNode*>(id);
+        if (element != nullptr) {
             value_bd solved_value_right_node = value->evaluate(var_map);
-            std::vector<value_bd> array_left = (*var_map)[id_n->name].array;
-            std::ostringstream os;
-            os << id_n->position.Double;
-            size_t pos = std::stoi(os.str());
-            std::vector<value_bd> array_changed;
-            for (size_t i = 0; i < array_left.size();++i){
-                if (i==pos) {
-                    array_changed.push_back(solved_value_right_node);
-                } else {
-                    array_changed.push_back(array_left[i]);
-                }
-            }
-            value_bd lhs = value_bd("array",array_changed);
-            (*var_map)[id_n->name] = lhs;
+            element->assign(var_map, solved_value_right_node);
             return solved_value_right_node;
         }
 
@@ -105,6 +228,48 @@ value_bd AssignmentNode::evaluate(std::unordered_map<std::string, value_bd>* var
         return solved_value_right_node;
 }
 
+// A proven number or bool is stored into the entry in place when the
+// variable already holds one of the same type
+double AssignmentNode::evaluate_double(std::unordered_map<std::string, value_bd>* var_map){
+        IdentifierNode* target = dynamic_cast<IdentifierNode*>(id);
+        if (value->proven != ProvenType::Double) {
+            return evaluate(var_map).Double;
+        }
+        if (target == nullptr) {
+            IndexNode* element = dynamic_cast<IndexNode*>(id);
+            if (element == nullptr || element->name.empty()) {
+                throw EvaluationError("invalid assignee.");
+            }
+            double result = value->evaluate_double(var_map);
+            size_t position;
+            element->locate(var_map, position)->store(position, result);
+            return result;
+        }
+        double result = value->evaluate_double(var_map);
+        value_bd& slot = (*var_map)[target->name];
+        if (slot.type_tag == "double") {
+            slot.Double = result;
+        } else {
+            slot = value_bd("double", result);
+        }
+        return result;
+}
+
+bool AssignmentNode::evaluate_bool(std::unordered_map<std::string, value_bd>* var_map){
+        IdentifierNode* target = dynamic_cast<IdentifierNode*>(id);
+        if (target == nullptr || value->proven != ProvenType::Bool) {
+            return evaluate(var_map).Bool;
+        }
+        bool result = value->evaluate_bool(var_map);
+        value_bd& slot = (*var_map)[target->name];
+        if (slot.type_tag == "bool") {
+            slot.Bool = result;
+        } else {
+            slot = value_bd("bool", result);
+        }
+        return result;
+}
+
 std::string AssignmentNode::print(){
         // if (id == nullptr) {
         //     throw EvaluationError("invalid assignee.");
@@ -112,418 +277,852 @@ std::string AssignmentNode::print(){
         return "(" + id->print() + " = " + value->print() + ")";
 }
 
+ASTNode* AssignmentNode::fold(){
+        value = value->fold();
+        return this;
+}
+
+ASTNode* AssignmentNode::clone(){
+        ASTNode* id_copy = id->clone();
+        ASTNode* value_copy = value->clone();
+        if (id_copy == nullptr || value_copy == nullptr) {
+            delete id_copy;
+            delete value_copy;
+            return nullptr;
+        }
+        return new AssignmentNode(line, column, id_copy, value_copy);
+}
+
 //----------------------
 
-AdditionNode::AdditionNode(int line, int column, ASTNode* left, ASTNode* right) : ASTNode(line, column), left(left), right(right){}
+OperatorNode::OperatorNode(int line, int column, ASTNode* left, ASTNode* right) : ASTNode(line, column), left(left), right(right){}
 
-AdditionNode::~AdditionNode(){
+OperatorNode::~OperatorNode(){
         delete left;
         delete right;
     }
 
-value_bd AdditionNode::evaluate(std::unordered_map<std::string, value_bd>* var_map){
-        if(left->evaluate(var_map).type_tag == "bool" || right->evaluate(var_map).type_tag == "bool"){
-            throw EvaluationError("invalid operand type.");
+// Collapses the node into a literal once both operands are literals. Operations
+// that fail (division by zero, bad operand types) are left in the tree so the
+// error is still raised when the program actually reaches them.
+ASTNode* OperatorNode::fold(){
+        left = left->fold();
+        right = right->fold();
+        if (!left->is_constant() || !right->is_constant()) {
+            return this;
         }
-        return value_bd("double",(left->evaluate(var_map).Double + right->evaluate(var_map).Double));
-    }
-    
-std::string AdditionNode::print(){
-        return "(" + left->print() + " + " + right->print() + ")";
+        value_bd result;
+        try {
+            result = evaluate(nullptr);
+        } catch (const EvaluationError& e) {
+            return this;
+        }
+        ASTNode* literal = nullptr;
+        if (result.type_tag == "double") {
+            literal = new NumberNode(line, column, result.Double, print());
+        } else if (result.type_tag == "bool") {
+            literal = new BooleanNode(line, column, result.Bool, print());
+        } else {
+            return this;
+        }
+        delete this;
+        return literal;
     }
 
 //----------------------
 
-SubtractionNode::SubtractionNode(int line, int column, ASTNode* left, ASTNode* right) : ASTNode(line, column), left(left), right(right){}
+ConditionalNode::ConditionalNode(int line, int column, ASTNode* condition, ASTNode* taken, ASTNode* other)
+        : ASTNode(line, column), condition(condition), taken(taken), other(other) {}
 
-SubtractionNode::~SubtractionNode(){
-        delete left;
-        delete right;
+ConditionalNode::~ConditionalNode(){
+        delete condition;
+        delete taken;
+        delete other;
     }
 
-value_bd SubtractionNode::evaluate(std::unordered_map<std::string, value_bd>* var_map){
-        if(left->evaluate(var_map).type_tag == "bool" || right->evaluate(var_map).type_tag == "bool"){
-            throw EvaluationError("invalid operand type.");
-        }
-        return value_bd("double",(left->evaluate(var_map).Double - right->evaluate(var_map).Double));
+value_bd ConditionalNode::evaluate(std::unordered_map<std::string, value_bd>* var_map){
+        return condition->evaluate_condition(var_map) ? taken->evaluate(var_map) : other->evaluate(var_map);
+    }
+
+double ConditionalNode::evaluate_double(std::unordered_map<std::string, value_bd>* var_map){
+        return condition->evaluate_condition(var_map) ? taken->evaluate_double(var_map) : other->evaluate_double(var_map);
+    }
+
+bool ConditionalNode::evaluate_bool(std::unordered_map<std::string, value_bd>* var_map){
+        return condition->evaluate_condition(var_map) ? taken->evaluate_bool(var_map) : other->evaluate_bool(var_map);
+    }
+
+std::string ConditionalNode::print(){
+        return "(" + condition->print() + " ? " + taken->print() + " : " + other->print() + ")";
     }
 
-std::string SubtractionNode::print(){
-        return "(" + left->print() + " - " + right->print() + ")";
+// A literal condition leaves only the selected operand, which keeps the
+// printed form of the whole expression when it is a literal as well
+ASTNode* ConditionalNode::fold(){
+        condition = condition->fold();
+        taken = taken->fold();
+        other = other->fold();
+        BooleanNode* selector = dynamic_cast<BooleanNode*>(condition);
+        if (selector == nullptr) {
+            return this;
+        }
+        ASTNode*& selected = selector->value.Bool ? taken : other;
+        ASTNode* result = selected;
+        if (NumberNode* number = dynamic_cast<NumberNode*>(result)) {
+            result = new NumberNode(line, column, number->value.Double, print());
+        } else if (BooleanNode* boolean = dynamic_cast<BooleanNode*>(result)) {
+            result = new BooleanNode(line, column, boolean->value.Bool, print());
+        } else {
+            selected = nullptr;
+        }
+        delete this;
+        return result;
+    }
+
+ASTNode* ConditionalNode::clone(){
+        ASTNode* c = condition->clone();
+        ASTNode* t = taken->clone();
+        ASTNode* o = other->clone();
+        if (c == nullptr || t == nullptr || o == nullptr) {
+            delete c;
+            delete t;
+            delete o;
+            return nullptr;
+        }
+        return new ConditionalNode(line, column, c, t, o);
     }
 
 //----------------------
 
-MultiplicationNode::MultiplicationNode(int line, int column, ASTNode* left, ASTNode* right) : ASTNode(line, column), left(left), right(right){}
-    
-MultiplicationNode::~MultiplicationNode(){
-        delete left;
-        delete right;
+ArrayNode::ArrayNode(int line, int column, std::vector<value_bd> array, std::vector<std::string> array_ele, std::string name) : ASTNode(line, column), name(name){
+    this->array_ele = {};
+    for (size_t i = 0; i< array_ele.size(); ++i ) {
+        this->array_ele.push_back(array_ele[i]);
+    }
+    value = value_bd("array", array);
+    value.pack();
+}
+
+ArrayNode::ArrayNode(int line, int column, std::vector<value_bd> array): ASTNode(line, column){
+    value = value_bd("array", array);
+    value.pack();
+}
+
+value_bd ArrayNode::evaluate(std::unordered_map<std::string, value_bd>*) {
+        return value;
     }
     
-value_bd MultiplicationNode::evaluate(std::unordered_map<std::string, value_bd>* var_map){
-        if(left->evaluate(var_map).type_tag == "bool" || right->evaluate(var_map).type_tag == "bool"){
-            throw EvaluationError("invalid operand type.");
+std::string ArrayNode::print(){
+        std::string array_str;
+        array_str+="[";
+        if (array_ele.size()>0) {
+            for (size_t i = 0; i< array_ele.size()-1; ++i ) {
+                array_str+= array_ele[i];
+                array_str+=", ";
+            }
+            array_str+= array_ele[array_ele.size()-1];
         }
-        return value_bd("double",(left->evaluate(var_map).Double * right->evaluate(var_map).Double));
+        array_str+="]";
+        return array_str;
     }
-    
-std::string MultiplicationNode::print(){
-        return "(" + left->print() + " * " + right->print() + ")";
+
+std::string ArrayNode::evaluate_print(std::vector<value_bd> arr) {
+    std::string str;
+    str+="[";
+    if (arr.size()>0) {
+        for (size_t i = 0; i< arr.size()-1; ++i) {
+            std::ostringstream os;
+            if(arr[i].type_tag == "bool") {
+                os << arr[i].Bool;
+                if (os.str()=="1"){
+                    str+="true";
+                } else {
+                    str+="false";
+                }
+            } else if(arr[i].type_tag == "double") {
+                os << arr[i].Double;
+                str+=os.str();
+            } else if (arr[i].type_tag == "null") {
+                str+=arr[i].Null;
+            } else if (arr[i].type_tag == "dict") {
+                str+=evaluate_print_dict(arr[i]);
+
+            } else {
+                str+=evaluate_print(arr[i].elements());
+            }
+            str+=", ";
+        }
+        std::ostringstream os;
+        if(arr[arr.size()-1].type_tag == "bool") {
+            os << arr[arr.size()-1].Bool;
+            if (os.str()=="1"){
+                str+="true";
+            } else {
+                str+="false";
+            }
+        } else if(arr[arr.size()-1].type_tag == "double") {
+            os << arr[arr.size()-1].Double;
+            str+=os.str();
+        } else if (arr[arr.size()-1].type_tag == "null") {
+            str+=arr[arr.size()-1].Null;
+        } else if (arr[arr.size()-1].type_tag == "dict") {
+            str+=evaluate_print_dict(arr[arr.size()-1]);
+
+        } else {
+            str+=evaluate_print(arr[arr.size()-1].elements());
+        }
     }
+    str+="]";
+    return str;
+}
+
+// {key: value, ...} in the order of the table; each key and value is printed
+// as the only element of an array, without the brackets
+std::string ArrayNode::evaluate_print_dict(const value_bd& dict) {
+    std::string str = "{";
+    std::vector<value_bd> keys = dict.dict->keys();
+    for (size_t i = 0; i < keys.size(); ++i) {
+        std::string key = evaluate_print({keys[i]});
+        std::string value = evaluate_print({*dict.dict->find(keys[i])});
+        str += (i == 0 ? "" : ", ") + key.substr(1, key.size() - 2) + ": " + value.substr(1, value.size() - 2);
+    }
+    return str + "}";
+}
 
 //----------------------
 
-DivisionNode::DivisionNode(int line, int column, ASTNode* left, ASTNode* right) : ASTNode(line, column), left(left), right(right){}
-    
-DivisionNode::~DivisionNode(){
-        delete left;
-        delete right;
+IndexNode::IndexNode(int line, int column, ASTNode* base, ASTNode* index) : ASTNode(line, column), base(base), index(index){
+    by_name = false;
+    if (IdentifierNode* variable = dynamic_cast<IdentifierNode*>(base)) {
+        name = variable->name;
+        by_name = true;
+    } else if (IndexNode* outer = dynamic_cast<IndexNode*>(base)) {
+        name = outer->name;
     }
-    
-value_bd DivisionNode::evaluate(std::unordered_map<std::string, value_bd>* var_map) {
-        if(left->evaluate(var_map).type_tag == "bool" || right->evaluate(var_map).type_tag == "bool"){
-            throw EvaluationError("invalid operand type.");
+}
+
+IndexNode::~IndexNode(){
+    delete base;
+    delete index;
+}
+
+// The index is evaluated before the base is looked up: it may assign, and an
+// assignment can rehash the map under a reference into it.
+//
+// For a matrix, row tells whether the element is one of its rows (m[i]). A
+// number m[i][j] is read straight from the matrix, without making the row.
+// For a dictionary the entry itself is returned, with position whole.
+const value_bd& IndexNode::container(std::unordered_map<std::string, value_bd>* var_map, value_bd& scratch, size_t& position, bool& row){
+    double at = 0;
+    bool number = true;
+    value_bd key;
+    if (index->proven == ProvenType::Double) {
+        at = index->evaluate_double(var_map);
+    } else {
+        key = index->evaluate(var_map);
+        number = key.type_tag == "double";
+        at = key.Double;
+    }
+    const value_bd* array = &scratch;
+    IndexNode* inner = by_name ? nullptr : dynamic_cast<IndexNode*>(base);
+    if (by_name) {
+        auto found = var_map->find(name);
+        if (found != var_map->end()) {
+            array = &found->second;
+        }
+    } else if (inner != nullptr && inner->by_name) {
+        size_t line;
+        bool matrix;
+        array = &inner->container(var_map, scratch, line, matrix);
+        if (matrix) {
+            if (!number) {
+                throw EvaluationError("index is not a number.");
+            }
+            if (at < 0 || at >= array->columns) {
+                throw EvaluationError("index out of bounds. really?");
+            }
+            row = false;
+            position = line * array->columns + (size_t)at;
+            return *array;
         }
-        if (right->evaluate(var_map).Double == 0.0) {
-            throw EvaluationError("division by zero.");
+        if (line != value_bd::whole) {  //a dictionary entry is indexed where it is
+            scratch = array->at(line);
+            array = &scratch;
         }
-        return value_bd("double",(left->evaluate(var_map).Double / right->evaluate(var_map).Double));
+    } else {
+        scratch = base->evaluate(var_map);
     }
-    
-std::string DivisionNode::print(){
-        return "(" + left->print() + " / " + right->print() + ")";
+    if (array->dict != nullptr) {
+        const value_bd* entry = array->dict->find(index->proven == ProvenType::Double ? value_bd("double", at) : key);
+        if (entry == nullptr) {
+            throw EvaluationError("key not in dictionary.");
+        }
+        row = false;
+        position = value_bd::whole;
+        return *entry;
+    }
+    row = array->columns != 0;
+    if (bounds == nullptr || !bounds->proven) {
+        if (!number) {
+            throw EvaluationError("index is not a number.");
+        }
+        if (at < 0 || at >= (row ? array->rows() : array->length())) {
+            throw EvaluationError("index out of bounds. really?");
+        }
     }
+    position = (size_t)at;
+    return *array;
+}
 
-//----------------------
+value_bd IndexNode::evaluate(std::unordered_map<std::string, value_bd>* var_map){
+    value_bd scratch;
+    size_t position;
+    bool row;
+    const value_bd& holder = container(var_map, scratch, position, row);
+    if (position == value_bd::whole) {
+        return holder;
+    }
+    return row ? holder.row(position) : holder.at(position);
+}
 
-ModuloNode::ModuloNode(int line, int column, ASTNode* left, ASTNode* right) : ASTNode(line, column), left(left), right(right){}
-    
-ModuloNode::~ModuloNode(){
-        delete left;
-        delete right;
+double IndexNode::evaluate_double(std::unordered_map<std::string, value_bd>* var_map){
+    value_bd scratch;
+    size_t position;
+    bool row;
+    const value_bd& holder = container(var_map, scratch, position, row);
+    if (position == value_bd::whole) {
+        return holder.Double;
     }
-    
-value_bd ModuloNode::evaluate(std::unordered_map<std::string, value_bd>* var_map) {
-        if(left->evaluate(var_map).type_tag == "bool" || right->evaluate(var_map).type_tag == "bool"){
-            throw EvaluationError("invalid operand type.");
+    return row ? holder.row(position).Double : holder.number_at(position);
+}
+
+bool IndexNode::evaluate_bool(std::unordered_map<std::string, value_bd>* var_map){
+    value_bd scratch;
+    size_t position;
+    bool row;
+    const value_bd& holder = container(var_map, scratch, position, row);
+    if (position == value_bd::whole) {
+        return holder.Bool;
+    }
+    return row ? holder.row(position).Bool : holder.flag_at(position);
+}
+
+// Whatever is written into is made an array first, like the variable itself
+// always was; an index outside the array is an error, as it is for a read. The array is
+// returned with the position rather than the element, so a store can keep it
+// packed; only an array that is itself indexed further (nested) is unpacked.
+// A matrix is written a number at a time: m[i][j] returns the matrix and the
+// position of the number, m[i] alone is not assignable. A dictionary returns
+// the entry, added when the key is new, with position whole.
+value_bd* IndexNode::locate(std::unordered_map<std::string, value_bd>* var_map, size_t& position, bool nested){
+    value_bd at = index->evaluate(var_map);
+    value_bd* array = nullptr;
+    if (by_name) {
+        array = &(*var_map)[name];
+    } else {
+        size_t outer;
+        value_bd* holder = static_cast<IndexNode*>(base)->locate(var_map, outer, true);
+        if (outer == value_bd::whole) {
+            array = holder;
+        } else if (holder->columns != 0) {
+            if (nested) {
+                throw EvaluationError("matrix elements are numbers.");
+            }
+            if (at.type_tag != "double") {
+                throw EvaluationError("index is not a number.");
+            }
+            if (at.Double < 0 || at.Double >= holder->columns) {
+                throw EvaluationError("index out of bounds. really?");
+            }
+            position = outer * holder->columns + (size_t)at.Double;
+            return holder;
+        } else {
+            array = holder->element(outer);
+        }
+    }
+    if (array->dict != nullptr) {
+        position = value_bd::whole;
+        return &Dictionary::own(*array).entry(at);
+    }
+    if (at.type_tag != "double") {
+        throw EvaluationError("index is not a number.");
+    }
+    if (array->columns != 0) {
+        if (!nested) {
+            throw EvaluationError("matrix rows cannot be assigned.");
         }
-        if (right->evaluate(var_map).Double == 0.0) {
-            throw EvaluationError("division by zero.");
+        if (at.Double < 0 || at.Double >= array->rows()) {
+            throw EvaluationError("index out of bounds. really?");
         }
-        double ans = std::fmod(left->evaluate(var_map).Double, right->evaluate(var_map).Double);
-        return value_bd("double", ans);
-
+        position = (size_t)at.Double;
+        return array;
     }
-    
-std::string ModuloNode::print(){
-        return "(" + left->print() + " % " + right->print() + ")";
+    if (array->type_tag != "array") {
+        *array = value_bd("array", std::vector<value_bd>());
+    }
+    if (at.Double < 0 || at.Double >= array->length()) {
+        throw EvaluationError("index out of bounds. really?");
+    }
+    position = (size_t)at.Double;
+    return array;
+}
+
+// Stores a value into the element, for an assignment and for the result of a
+// call assigned to an element
+void IndexNode::assign(std::unordered_map<std::string, value_bd>* var_map, const value_bd& value){
+    size_t position;
+    value_bd* array = locate(var_map, position);
+    if (position != value_bd::whole && array->columns != 0 && value.type_tag != "double") {
+        throw EvaluationError("matrix elements are numbers.");
     }
+    array->store(position, value);
+}
+
+ASTNode* IndexNode::clone(){
+    ASTNode* base_copy = base->clone();
+    ASTNode* index_copy = index->clone();
+    if (base_copy == nullptr || index_copy == nullptr) {
+        delete base_copy;
+        delete index_copy;
+        return nullptr;
+    }
+    IndexNode* copy = new IndexNode(line, column, base_copy, index_copy);
+    copy->bounds = bounds;
+    return copy;
+}
 
 //----------------------
 
-LessNode::LessNode(int line, int column, ASTNode* left, ASTNode* right) : ASTNode(line, column), left(left), right(right){}
-    
-LessNode::~LessNode(){
-        delete left;
-        delete right;
+static std::vector<std::unique_ptr<RecordLayout>> layouts;         //every one declared
+static std::unordered_map<std::string, const RecordLayout*> declared;   //the latest of each name
+
+size_t RecordLayout::slot(const std::string& field) const{
+    return std::find(fields.begin(), fields.end(), field) - fields.begin();
+}
+
+const RecordLayout* RecordLayout::declare(const std::string& name, const std::vector<std::string>& fields){
+    layouts.emplace_back(new RecordLayout{name, fields});
+    declared[name] = layouts.back().get();
+    return layouts.back().get();
+}
+
+const RecordLayout* RecordLayout::find(const std::string& name){
+    auto found = declared.find(name);
+    return found == declared.end() ? nullptr : found->second;
+}
+
+FieldNode::FieldNode(int line, int column, ASTNode* base, const std::string& field) : IndexNode(line, column, base, nullptr), field(field){}
+
+size_t FieldNode::slot_in(const value_bd& record){
+    if (record.layout == nullptr) {
+        throw EvaluationError("value has no fields.");
     }
-    
-value_bd LessNode::evaluate(std::unordered_map<std::string, value_bd>* var_map) {
-        if(left->evaluate(var_map).type_tag == "bool" || right->evaluate(var_map).type_tag == "bool"){
-            throw EvaluationError("invalid operand type.");
+    if (record.layout != cached) {
+        size_t slot = record.layout->slot(field);
+        if (slot == record.layout->fields.size()) {
+            throw EvaluationError("record has no field " + field + ".");
         }
-        return value_bd("bool", left->evaluate(var_map).Double < right->evaluate(var_map).Double);
+        cached = record.layout;
+        cached_slot = slot;
     }
-    
-std::string LessNode::print(){
-        return "(" + left->print() + " < " + right->print() + ")";
+    return cached_slot;
+}
+
+// The record is found like IndexNode finds an array: in the map, or where it
+// sits in its array or dictionary (a[i].x), without copying it
+const value_bd& FieldNode::container(std::unordered_map<std::string, value_bd>* var_map, value_bd& scratch, size_t& position, bool& row){
+    const value_bd* record = &scratch;
+    IndexNode* inner = by_name ? nullptr : dynamic_cast<IndexNode*>(base);
+    if (by_name) {
+        auto found = var_map->find(name);
+        if (found != var_map->end()) {
+            record = &found->second;
+        }
+    } else if (inner != nullptr && inner->by_name) {
+        size_t line;
+        bool matrix;
+        const value_bd& outer = inner->container(var_map, scratch, line, matrix);
+        if (line == value_bd::whole) {
+            record = &outer;
+        } else if (!matrix && outer.packed == nullptr) {
+            record = &outer.array[line];
+        }
+    } else {
+        scratch = base->evaluate(var_map);
     }
+    row = false;
+    position = slot_in(*record);
+    return *record;
+}
 
-//----------------------
+value_bd* FieldNode::locate(std::unordered_map<std::string, value_bd>* var_map, size_t& position, bool){
+    value_bd* record = nullptr;
+    if (by_name) {
+        auto found = var_map->find(name);
+        if (found == var_map->end()) {
+            throw EvaluationError("value has no fields.");
+        }
+        record = &found->second;
+    } else {
+        size_t outer;
+        record = static_cast<IndexNode*>(base)->locate(var_map, outer, true);
+        if (outer != value_bd::whole) {
+            if (record->columns != 0) {
+                throw EvaluationError("value has no fields.");
+            }
+            record = record->element(outer);
+        }
+    }
+    position = slot_in(*record);
+    return record;
+}
 
-LessEqualNode::LessEqualNode(int line, int column, ASTNode* left, ASTNode* right) : ASTNode(line, column), left(left), right(right){}
-    
-LessEqualNode::~LessEqualNode(){
-        delete left;
-        delete right;
+ASTNode* FieldNode::clone(){
+    ASTNode* base_copy = base->clone();
+    if (base_copy == nullptr) {
+        return nullptr;
     }
-    
-value_bd LessEqualNode::evaluate(std::unordered_map<std::string, value_bd>* var_map) {
-        if(left->evaluate(var_map).type_tag == "bool" || right->evaluate(var_map).type_tag == "bool"){
-            throw EvaluationError("invalid operand type.");
+    return new FieldNode(line, column, base_copy, field);
+}
+
+RecordNode::RecordNode(int line, int column, const RecordLayout* layout, std::vector<ASTNode*> fields) : ASTNode(line, column), layout(layout), fields(fields){}
+
+RecordNode::~RecordNode(){
+    for (ASTNode* field : fields) {
+        delete field;
+    }
+}
+
+value_bd RecordNode::evaluate(std::unordered_map<std::string, value_bd>* var_map){
+    value_bd result("record", std::vector<value_bd>());
+    result.array.reserve(fields.size());
+    for (ASTNode* field : fields) {
+        result.array.push_back(field->evaluate(var_map));
+    }
+    result.layout = layout;
+    return result;
+}
+
+std::string RecordNode::print(){
+    std::string text = layout->name + "(";
+    for (size_t i = 0; i < fields.size(); i++) {
+        text += (i == 0 ? "" : ", ") + fields[i]->print();
+    }
+    return text + ")";
+}
+
+std::vector<ASTNode**> RecordNode::children(){
+    std::vector<ASTNode**> nodes;
+    for (ASTNode*& field : fields) {
+        nodes.push_back(&field);
+    }
+    return nodes;
+}
+
+ASTNode* RecordNode::clone(){
+    std::vector<ASTNode*> copies;
+    for (ASTNode* field : fields) {
+        copies.push_back(field->clone());
+        if (copies.back() == nullptr) {
+            for (ASTNode* copy : copies) {
+                delete copy;
+            }
+            return nullptr;
         }
-        return value_bd("bool", left->evaluate(var_map).Double <= right->evaluate(var_map).Double);
     }
-    
-std::string LessEqualNode::print(){
-        return "(" + left->print() + " <= " + right->print() + ")";
+    return new RecordNode(line, column, layout, copies);
+}
+
+std::string RecordDeclNode::print(){
+    std::string text = "record " + layout->name + "(";
+    for (size_t i = 0; i < layout->fields.size(); i++) {
+        text += (i == 0 ? "" : ", ") + layout->fields[i];
     }
+    return text + ")";
+}
 
 //----------------------
 
-MoreNode::MoreNode(int line, int column, ASTNode* left, ASTNode* right) : ASTNode(line, column), left(left), right(right){}
-    
-MoreNode::~MoreNode(){
-        delete left;
-        delete right;
+SliceNode::SliceNode(int line, int column, ASTNode* base, ASTNode* from, ASTNode* to) : ASTNode(line, column), base(base), from(from), to(to){
+    if (IdentifierNode* variable = dynamic_cast<IdentifierNode*>(base)) {
+        name = variable->name;
     }
-    
-value_bd MoreNode::evaluate(std::unordered_map<std::string, value_bd>* var_map) {
-        if(left->evaluate(var_map).type_tag == "bool" || right->evaluate(var_map).type_tag == "bool"){
-            throw EvaluationError("invalid operand type.");
-        }
-        return value_bd("bool", left->evaluate(var_map).Double > right->evaluate(var_map).Double);
+}
+
+SliceNode::~SliceNode(){
+    delete base;
+    delete from;
+    delete to;
+}
+
+static double slice_bound(ASTNode* bound, std::unordered_map<std::string, value_bd>* var_map){
+    value_bd position = bound->evaluate(var_map);
+    if (position.type_tag != "double") {
+        throw EvaluationError("index is not a number.");
     }
-    
-std::string MoreNode::print(){
-        return "(" + left->print() + " > " + right->print() + ")";
+    return position.Double;
+}
+
+// Bounds first, then the base, found in the map like IndexNode does
+value_bd SliceNode::evaluate(std::unordered_map<std::string, value_bd>* var_map){
+    double first = from != nullptr ? slice_bound(from, var_map) : 0;
+    double last = to != nullptr ? slice_bound(to, var_map) : -1;
+    value_bd scratch;
+    const value_bd* array = &scratch;
+    auto found = name.empty() ? var_map->end() : var_map->find(name);
+    if (found != var_map->end()) {
+        array = &found->second;
+    } else {
+        scratch = base->evaluate(var_map);
+    }
+    if (array->type_tag != "array") {
+        throw EvaluationError("sliced value is not an array.");
+    }
+    if (to == nullptr) {
+        last = array->length();
+    }
+    if (first < 0 || last < first || last > array->length()) {
+        throw EvaluationError("index out of bounds. really?");
+    }
+    return array->range((size_t)first, (size_t)last);
+}
+
+std::string SliceNode::print(){
+    return base->print() + "[" + (from ? from->print() : "") + ":" + (to ? to->print() : "") + "]";
+}
+
+std::vector<ASTNode**> SliceNode::children(){
+    std::vector<ASTNode**> nodes = {&base};
+    if (from != nullptr) {
+        nodes.push_back(&from);
+    }
+    if (to != nullptr) {
+        nodes.push_back(&to);
+    }
+    return nodes;
+}
+
+ASTNode* SliceNode::clone(){
+    ASTNode* base_copy = base->clone();
+    ASTNode* from_copy = from ? from->clone() : nullptr;
+    ASTNode* to_copy = to ? to->clone() : nullptr;
+    if (base_copy == nullptr || (from && from_copy == nullptr) || (to && to_copy == nullptr)) {
+        delete base_copy;
+        delete from_copy;
+        delete to_copy;
+        return nullptr;
+    }
+    return new SliceNode(line, column, base_copy, from_copy, to_copy);
+}
+
+//----------------------
+
+RangeNode::~RangeNode(){
+    delete from;
+    delete to;
+}
+
+value_bd RangeNode::evaluate(std::unordered_map<std::string, value_bd>*){
+    throw EvaluationError("a range is only used by for.");
+}
+
+ASTNode* RangeNode::fold(){
+    from = from->fold();
+    to = to->fold();
+    return this;
+}
+
+ASTNode* RangeNode::clone(){
+    ASTNode* from_copy = from->clone();
+    ASTNode* to_copy = to->clone();
+    if (from_copy == nullptr || to_copy == nullptr) {
+        delete from_copy;
+        delete to_copy;
+        return nullptr;
     }
+    return new RangeNode(line, column, from_copy, to_copy);
+}
 
 //----------------------
 
-MoreEqualNode::MoreEqualNode(int line, int column, ASTNode* left, ASTNode* right) : ASTNode(line, column), left(left), right(right){}
-    
-MoreEqualNode::~MoreEqualNode(){
-        delete left;
-        delete right;
-    }
-    
-value_bd MoreEqualNode::evaluate(std::unordered_map<std::string, value_bd>* var_map) {
-        if(left->evaluate(var_map).type_tag == "bool" || right->evaluate(var_map).type_tag == "bool"){
-            throw EvaluationError("invalid operand type.");
-        }
-        return value_bd("bool", left->evaluate(var_map).Double >= right->evaluate(var_map).Double);
+DictNode::DictNode(int line, int column, std::vector<ASTNode*> keys, std::vector<ASTNode*> values) : ASTNode(line, column), keys(keys), values(values){}
+
+DictNode::~DictNode(){
+    for (size_t i = 0; i < keys.size(); i++) {
+        delete keys[i];
+        delete values[i];
     }
-    
-std::string MoreEqualNode::print(){
-        return "(" + left->print() + " >= " + right->print() + ")";
+}
+
+value_bd DictNode::evaluate(std::unordered_map<std::string, value_bd>* var_map){
+    value_bd result("dict", std::vector<value_bd>());
+    result.dict = std::make_shared<Dictionary>();
+    for (size_t i = 0; i < keys.size(); i++) {
+        value_bd key = keys[i]->evaluate(var_map);
+        value_bd value = values[i]->evaluate(var_map);
+        result.dict->entry(key) = value;
     }
+    return result;
+}
 
-//----------------------
+std::string DictNode::print(){
+    std::string text = "{";
+    for (size_t i = 0; i < keys.size(); i++) {
+        text += (i == 0 ? "" : ", ") + keys[i]->print() + ": " + values[i]->print();
+    }
+    return text + "}";
+}
 
-EqualNode::EqualNode(int line, int column, ASTNode* left, ASTNode* right) : ASTNode(line, column), left(left), right(right){}
-    
-EqualNode::~EqualNode(){
-        delete left;
-        delete right;
+std::vector<ASTNode**> DictNode::children(){
+    std::vector<ASTNode**> nodes;
+    for (size_t i = 0; i < keys.size(); i++) {
+        nodes.push_back(&keys[i]);
+        nodes.push_back(&values[i]);
     }
-    
-value_bd EqualNode::evaluate(std::unordered_map<std::string, value_bd>* var_map) {
-        if(left->evaluate(var_map).type_tag != right->evaluate(var_map).type_tag) {
-            return value_bd("bool", false);
-        }
-        if (left->evaluate(var_map).type_tag == "array" || right->evaluate(var_map).type_tag == "array") {
-            return value_bd("bool", false);
+    return nodes;
+}
 
+ASTNode* DictNode::clone(){
+    std::vector<ASTNode*> key_copies;
+    std::vector<ASTNode*> value_copies;
+    for (size_t i = 0; i < keys.size(); i++) {
+        key_copies.push_back(keys[i]->clone());
+        value_copies.push_back(values[i]->clone());
+        if (key_copies.back() == nullptr || value_copies.back() == nullptr) {
+            for (size_t j = 0; j <= i; j++) {
+                delete key_copies[j];
+                delete value_copies[j];
+            }
+            return nullptr;
         }
-        if(left->evaluate(var_map).type_tag == "bool") {
-            return value_bd("bool", left->evaluate(var_map).Bool == right->evaluate(var_map).Bool);
-        } else {
-            return value_bd("bool", left->evaluate(var_map).Double == right->evaluate(var_map).Double);
-        }
-    }
-    
-std::string EqualNode::print(){
-        return "(" + left->print() + " == " + right->print() + ")";
     }
+    return new DictNode(line, column, key_copies, value_copies);
+}
 
 //----------------------
 
-NotEqualNode::NotEqualNode(int line, int column, ASTNode* left, ASTNode* right) : ASTNode(line, column), left(left), right(right){}
-    
-NotEqualNode::~NotEqualNode(){
-        delete left;
-        delete right;
-    }
-    
-value_bd NotEqualNode::evaluate(std::unordered_map<std::string, value_bd>* var_map) {
-        if(left->evaluate(var_map).type_tag != right->evaluate(var_map).type_tag) {
-            return value_bd("bool", true);
-        }
-        if(left->evaluate(var_map).type_tag == "bool") {
-            return value_bd("bool", left->evaluate(var_map).Bool != right->evaluate(var_map).Bool);
-        } else {
-            return value_bd("bool", left->evaluate(var_map).Double != right->evaluate(var_map).Double);
-        }
-    }
-    
-std::string NotEqualNode::print(){
-        return "(" + left->print() + " != " + right->print() + ")";
-    }
+TempStoreNode::TempStoreNode(std::shared_ptr<value_bd> slot, std::string name, ASTNode* expression) : ASTNode(0, 0), slot(slot), name(name), expression(expression){
+    proven = expression->proven;
+}
+
+TempStoreNode::~TempStoreNode(){
+    delete expression;
+}
+
+value_bd TempStoreNode::evaluate(std::unordered_map<std::string, value_bd>* var_map){
+    *slot = expression->evaluate(var_map);
+    return *slot;
+}
+
+std::string TempStoreNode::print(){
+    return "(" + name + " = " + expression->print() + ")";
+}
 
 //----------------------
 
-LandNode::LandNode(int line, int column, ASTNode* left, ASTNode* right) : ASTNode(line, column), left(left), right(right){}
-    
-LandNode::~LandNode(){
-        delete left;
-        delete right;
-    }
-    
-value_bd LandNode::evaluate(std::unordered_map<std::string, value_bd>* var_map) {
-        if(left->evaluate(var_map).type_tag != "bool" || right->evaluate(var_map).type_tag != "bool"){
-            throw EvaluationError("invalid operand type.");
-        }
-        return value_bd("bool", left->evaluate(var_map).Bool && right->evaluate(var_map).Bool);
-    }
-    
-std::string LandNode::print(){
-        return "(" + left->print() + " & " + right->print() + ")";
-    }
+TempLoadNode::TempLoadNode(std::shared_ptr<value_bd> slot, std::string name) : ASTNode(0, 0), slot(slot), name(name){}
+
+value_bd TempLoadNode::evaluate(std::unordered_map<std::string, value_bd>*){
+    return *slot;
+}
+
+std::string TempLoadNode::print(){
+    return name;
+}
 
 //----------------------
 
-LxorNode::LxorNode(int line, int column, ASTNode* left, ASTNode* right) : ASTNode(line, column), left(left), right(right){}
-    
-LxorNode::~LxorNode(){
-        delete left;
-        delete right;
-    }
-    
-value_bd LxorNode::evaluate(std::unordered_map<std::string, value_bd>* var_map) {
-        if(left->evaluate(var_map).type_tag != "bool" || right->evaluate(var_map).type_tag != "bool"){
-            throw EvaluationError("invalid operand type.");
-        }
-        return value_bd("bool", ((!left->evaluate(var_map).Bool) && right->evaluate(var_map).Bool) || (left->evaluate(var_map).Bool && (!right->evaluate(var_map).Bool)));
-    }
-    
-std::string LxorNode::print(){
-        return "(" + left->print() + " ^ " + right->print() + ")";
+InvariantNode::InvariantNode(std::string name, ASTNode* expression, std::shared_ptr<InvariantCache> cache) : ASTNode(0, 0), name(name), expression(expression), cache(cache){
+    proven = expression->proven;
+}
+
+InvariantNode::~InvariantNode(){
+    delete expression;
+}
+
+value_bd InvariantNode::evaluate(std::unordered_map<std::string, value_bd>* var_map){
+    if (!cache->cached) {
+        cache->value = expression->evaluate(var_map);
+        cache->cached = true;
     }
+    return cache->value;
+}
+
+double InvariantNode::evaluate_double(std::unordered_map<std::string, value_bd>* var_map){
+    return cache->cached ? cache->value.Double : evaluate(var_map).Double;
+}
+
+std::string InvariantNode::print(){
+    return name;
+}
 
 //----------------------
 
-LorNode::LorNode(int line, int column, ASTNode* left, ASTNode* right) : ASTNode(line, column), left(left), right(right){}
-    
-LorNode::~LorNode(){
-        delete left;
-        delete right;
-    }
-    
-value_bd LorNode::evaluate(std::unordered_map<std::string, value_bd>* var_map) {
-        if(left->evaluate(var_map).type_tag != "bool" || right->evaluate(var_map).type_tag != "bool"){
-            throw EvaluationError("invalid operand type.");
-        }
-        return value_bd("bool", left->evaluate(var_map).Bool || right->evaluate(var_map).Bool);
+// beyond this the running sum could stop being exact
+static const double exact_limit = 4503599627370496.0; //2^52
+
+static bool is_exact_integer(double x){
+    return std::fabs(x) < exact_limit && x == std::floor(x);
+}
+
+ReducedProductNode::ReducedProductNode(MultiplicationNode* product, bool variable_on_left, std::shared_ptr<ReducedProduct> state) : ASTNode(0, 0), product(product), state(state){
+    variable = variable_on_left ? product->left : product->right;
+    factor = variable_on_left ? product->right : product->left;
+    proven = product->proven;
+}
+
+ReducedProductNode::~ReducedProductNode(){
+    delete product;
+}
+
+value_bd ReducedProductNode::evaluate(std::unordered_map<std::string, value_bd>* var_map){
+    if (state->valid) {
+        return value_bd("double", state->value);
     }
-    
-std::string LorNode::print(){
-        return "(" + left->print() + " | " + right->print() + ")";
+    value_bd result = product->evaluate(var_map);
+    value_bd v = variable->evaluate(var_map);
+    value_bd f = factor->evaluate(var_map);
+    if (v.type_tag == "double" && f.type_tag == "double" && is_exact_integer(v.Double) && is_exact_integer(f.Double) && is_exact_integer(result.Double) && is_exact_integer(state->increment * f.Double)) {
+        state->value = result.Double;
+        state->step = state->increment * f.Double;
+        state->valid = true;
     }
+    return result;
+}
+
+std::string ReducedProductNode::print(){
+    return state->name;
+}
 
 //----------------------
 
-ArrayNode::ArrayNode(int line, int column, std::vector<value_bd> array, std::vector<std::string> array_ele, std::string name) : ASTNode(line, column), name(name){
-    this->array = {};
-    for (size_t i = 0; i< array.size(); ++i ) {
-        this->array.push_back(array[i]);
-    }
-    this->array_ele = {};
-    for (size_t i = 0; i< array_ele.size(); ++i ) {
-        this->array_ele.push_back(array_ele[i]);
-    }
-    this->node = nullptr;
+InductionStepNode::InductionStepNode(ASTNode* assignment, std::vector<ReducedProductNode*> products) : ASTNode(0, 0), assignment(assignment), products(products){
+    proven = assignment->proven;
 }
 
-ArrayNode::ArrayNode(int line, int column, ASTNode* node, value_bd position, std::vector<std::string> array_ele, std::string name) : ASTNode(line, column), node(node), array_ele(array_ele), position(position), name(name) {}
-    
-ArrayNode::ArrayNode(int line, int column, std::vector<value_bd> array): ASTNode(line, column){
-    this->array = {};
-    for (size_t i = 0; i< array.size(); ++i ) {
-        this->array.push_back(array[i]);
-    }
-    this->node = nullptr;
+InductionStepNode::~InductionStepNode(){
+    delete assignment;
 }
 
-ArrayNode::~ArrayNode(){
-        delete node;
-    }
-    
-value_bd ArrayNode::evaluate(std::unordered_map<std::string, value_bd>* var_map) {
-        if (node != nullptr) {
-            value_bd val = (*var_map)[node->print()];
-            if (node->print()[0] == '[') {
-                val = node->evaluate(var_map);
-            }
-            if (position.type_tag!="double") {
-                throw EvaluationError("index is not a number.");
-            }
-            if (position.Double < 0 || position.Double >= val.array.size()) {
-                throw EvaluationError("index out of bounds. really?");
-            }
-            return val.array[position.Double];
-        }
-        return value_bd("array", array, array_ele);
-    }
-    
-std::string ArrayNode::print(){
-        std::string array_str;
-        if (node != nullptr){
-            for (size_t i = 0; i< array_ele.size(); ++i ) {
-                array_str+= array_ele[i];
-            }
-            return array_str;
-        }
-        array_str+="[";
-        if (array_ele.size()>0) {
-            for (size_t i = 0; i< array_ele.size()-1; ++i ) {
-                array_str+= array_ele[i];
-                array_str+=", ";
-            }
-            array_str+= array_ele[array_ele.size()-1];
+value_bd InductionStepNode::evaluate(std::unordered_map<std::string, value_bd>* var_map){
+    value_bd result = assignment->evaluate(var_map);
+    for (ReducedProductNode* product : products) {
+        ReducedProduct& state = *product->state;
+        if (state.valid) {
+            state.value += state.step;
+            state.valid = is_exact_integer(state.value);
         }
-        array_str+="]";
-        return array_str;
     }
+    return result;
+}
 
-std::string ArrayNode::evaluate_print(std::vector<value_bd> arr) {
-    std::string str;
-    str+="[";
-    if (arr.size()>0) {
-        for (size_t i = 0; i< arr.size()-1; ++i) {
-            std::ostringstream os;
-            if(arr[i].type_tag == "bool") {
-                os << arr[i].Bool;
-                if (os.str()=="1"){
-                    str+="true";
-                } else {
-                    str+="false";
-                }
-            } else if(arr[i].type_tag == "double") {
-                os << arr[i].Double;
-                str+=os.str();
-            } else if (arr[i].type_tag == "null") {
-                str+=arr[i].Null;
-            } else {
-                ArrayNode* arr_ele = new ArrayNode(0,0, arr[i].array);
-                str+=arr_ele->evaluate_print(arr[i].array);
-                delete arr_ele;
-                arr_ele = nullptr;
-            }
-            str+=", ";
-        }
+std::string InductionStepNode::print(){
+    std::string str = assignment->print();
+    for (ReducedProductNode* product : products) {
         std::ostringstream os;
-        if(arr[arr.size()-1].type_tag == "bool") {
-            os << arr[arr.size()-1].Bool;
-            if (os.str()=="1"){
-                str+="true";
-            } else {
-                str+="false";
-            }
-        } else if(arr[arr.size()-1].type_tag == "double") {
-            os << arr[arr.size()-1].Double;
-            str+=os.str();
-        } else if (arr[arr.size()-1].type_tag == "null") {
-            str+=arr[arr.size()-1].Null;
-        } else {
-            ArrayNode* arr_ele = new ArrayNode(0,0, arr[arr.size()-1].array);
-            str+=arr_ele->evaluate_print(arr[arr.size()-1].array);
-            delete arr_ele;
-            arr_ele = nullptr;
-        }
+        os << product->state->increment;
+        str += ", (" + product->state->name + " += (" + os.str() + " * " + product->factor->print() + "))";
     }
-    str+="]";
     return str;
 }
 
@@ -542,12 +1141,15 @@ ASTree::ASTree(const std::vector<token>& Tokens, std::unordered_map<std::string,
         if (get_current_token().type != TokenType::END){
             throw ParseError(get_current_token().row, get_current_token().col, get_current_token());
         }
+        head = head->fold();
     }  catch (const ParseError& e){
         delete head;
         throw e;
     }
 }
 
+ASTree::ASTree(ASTNode* head, std::unordered_map<std::string, value_bd>* map) : head(head), var_map(map) {}
+
 ASTree::~ASTree(){
     delete head;
 }
@@ -556,6 +1158,24 @@ value_bd ASTree::evaluate(){
     return head->evaluate(var_map);
 }
 
+value_bd ASTree::evaluate(std::unordered_map<std::string, value_bd>* map){
+    return head->evaluate(map);
+}
+
+void ASTree::evaluate_statement(std::unordered_map<std::string, value_bd>* map){
+    switch (head->proven) {
+        case ProvenType::Double:
+            head->evaluate_double(map);
+            break;
+        case ProvenType::Bool:
+            head->evaluate_bool(map);
+            break;
+        default:
+            head->evaluate(map);
+            break;
+    }
+}
+
 void ASTree::print(){
     std::cout << head->print() << std::endl;
 }
@@ -581,7 +1201,7 @@ ASTNode* ASTree::parse_assignment() {
     ASTNode* value = nullptr;
     
     try{
-        node = parse_Lor();
+        node = parse_conditional();
 
         if (get_current_token().type == TokenType::OPERATOR && get_current_token().text == "=") {
             int temp_row            = get_current_token().row;
@@ -591,45 +1211,6 @@ ASTNode* ASTree::parse_assignment() {
             
             value = parse_assignment();
             return new AssignmentNode(temp_row, temp_col, node, value);
-        } else if (get_current_token().type == TokenType::L_SQUARE){
-            ArrayNode* nod = static_cast<ArrayNode*>(node);
-            std::string name = nod->name;
-            std::vector<std::string> id_s;
-            id_s.push_back(nod->print());
-            std::vector<token> id_n;
-            if (get_current_token().type == TokenType::L_SQUARE){
-                int temp_row            = get_current_token().row;
-                int temp_col            = get_current_token().col;
-                token temp_token        = get_current_token();
-                id_s.push_back(get_current_token().text);
-                consume_token();
-                value_bd pos;
-                while (true) {
-                    if (get_current_token().type == TokenType::END) {
-                        throw ParseError(get_current_token().row, get_current_token().col, get_current_token());
-                    } else if (get_current_token().type == TokenType::R_SQUARE) {
-                        break;
-                    }
-                    id_n.push_back(get_current_token());
-                    consume_token();
-                }
-                if (get_current_token().type != TokenType::R_SQUARE) {
-                    throw ParseError(get_current_token().row, get_current_token().col, get_current_token());
-                }
-                consume_token();
-                id_n.push_back(getToken(get_current_token().row, get_current_token().col, "END", TokenType::END));
-                ASTree* expression_tree = new ASTree(id_n, var_map);
-                id_s.push_back(expression_tree->print_no_endl());
-                id_s.push_back("]");
-                pos = expression_tree->evaluate();
-                value_bd value_var_map = value_bd("array", (*nod).array);
-                if(var_map == nullptr){
-                    var_map = new std::unordered_map<std::string, value_bd>;
-                }
-                (*var_map)[name] = value_var_map;
-                delete expression_tree;
-                return new ArrayNode(temp_row, temp_col, nod, pos, id_s, name);
-            }
         }
         
         return node;
@@ -641,6 +1222,36 @@ ASTNode* ASTree::parse_assignment() {
     }
 }
 
+// cond ? a : b binds looser than | and groups to the right
+ASTNode* ASTree::parse_conditional() {
+    ASTNode* node = nullptr;
+    ASTNode* taken = nullptr;
+    ASTNode* other = nullptr;
+
+    try{
+        node = parse_Lor();
+
+        if (get_current_token().type == TokenType::QUESTION) {
+            int temp_row            = get_current_token().row;
+            int temp_col            = get_current_token().col;
+            consume_token();
+            taken = parse_conditional();
+            if (get_current_token().type != TokenType::COLON) {
+                throw ParseError(get_current_token().row, get_current_token().col, get_current_token());
+            }
+            consume_token();
+            other = parse_conditional();
+            return new ConditionalNode(temp_row, temp_col, node, taken, other);
+        }
+        return node;
+    } catch (const ParseError& e){
+        delete node;
+        delete taken;
+        delete other;
+        throw e;
+    }
+}
+
 ASTNode* ASTree::parse_Lor() {
     ASTNode* node = nullptr;
     ASTNode* value = nullptr;
@@ -837,7 +1448,59 @@ ASTNode* ASTree::parse_multiplication_division_modulo() {
     }
 }
 
+// A primary expression followed by any number of subscripts and fields,
+// a[i][j] or a[i].x. The index stays an expression and is evaluated each time
+// the element is used.
 ASTNode* ASTree::parse_factor() {
+    ASTNode* node = parse_primary();
+    while (get_current_token().type == TokenType::L_SQUARE || get_current_token().type == TokenType::DOT) {
+        int temp_row            = get_current_token().row;
+        int temp_col            = get_current_token().col;
+        bool field = get_current_token().type == TokenType::DOT;
+        consume_token();
+        if (field) {
+            if (get_current_token().type != TokenType::VARIABLES) {
+                delete node;
+                throw ParseError(get_current_token().row, get_current_token().col, get_current_token());
+            }
+            node = new FieldNode(temp_row, temp_col, node, get_current_token().text);
+            consume_token();
+            continue;
+        }
+        ASTNode* index = nullptr;
+        ASTNode* end = nullptr;
+        bool slice = false;
+        try {
+            if (get_current_token().type != TokenType::COLON) {
+                index = parse_expression();
+            }
+            if (get_current_token().type == TokenType::COLON) {
+                slice = true;
+                consume_token();
+                if (get_current_token().type != TokenType::R_SQUARE) {
+                    end = parse_expression();
+                }
+            }
+            if (get_current_token().type != TokenType::R_SQUARE) {
+                throw ParseError(get_current_token().row, get_current_token().col, get_current_token());
+            }
+        } catch (const ParseError& e) {
+            delete node;
+            delete index;
+            delete end;
+            throw e;
+        }
+        consume_token();
+        if (slice) {
+            node = new SliceNode(temp_row, temp_col, node, index ? index->fold() : nullptr, end ? end->fold() : nullptr);
+        } else {
+            node = new IndexNode(temp_row, temp_col, node, index->fold());
+        }
+    }
+    return node;
+}
+
+ASTNode* ASTree::parse_primary() {
     try{
         if (get_current_token().type == TokenType::LEFT_PAREN) {
             consume_token();
@@ -852,52 +1515,75 @@ ASTNode* ASTree::parse_factor() {
             ASTNode* node = new NumberNode(get_current_token().row, get_current_token().col, get_current_token().text);
             consume_token();
             return node;
-        } else if (get_current_token().type == TokenType::VARIABLES) {
-            std::string name = get_current_token().text;
-            ASTNode* node = new IdentifierNode(get_current_token().row, get_current_token().col, get_current_token().text);
-            std::vector<std::string> id_s;
-            id_s.push_back(node->print());
-            std::vector<token> id_n;
+        } else if (get_current_token().type == TokenType::VARIABLES && tokens[current_token_index + 1].type == TokenType::LEFT_PAREN && RecordLayout::find(get_current_token().text) != nullptr) {
+            //Point(1, 2), one expression for each declared field
+            const RecordLayout* layout = RecordLayout::find(get_current_token().text);
+            int temp_row = get_current_token().row;
+            int temp_col = get_current_token().col;
             consume_token();
-            if (get_current_token().type == TokenType::L_SQUARE){
-                int temp_row            = get_current_token().row;
-                int temp_col            = get_current_token().col;
-                token temp_token        = get_current_token();
-                id_s.push_back(get_current_token().text);
-                consume_token();
-                value_bd pos;
-                while (true) {
-                    if (get_current_token().type == TokenType::END) {
-                        throw ParseError(get_current_token().row, get_current_token().col, get_current_token());
-                    } else if (get_current_token().type == TokenType::R_SQUARE) {
-                        break;
+            consume_token();
+            std::vector<ASTNode*> fields;
+            try {
+                while (get_current_token().type != TokenType::RIGHT_PAREN) {
+                    if (!fields.empty()) {
+                        if (get_current_token().type != TokenType::COMMA) {
+                            throw ParseError(get_current_token().row, get_current_token().col, get_current_token());
+                        }
+                        consume_token();
                     }
-                    id_n.push_back(get_current_token());
-                    consume_token();
+                    fields.push_back(parse_expression()->fold());
                 }
-                if (get_current_token().type != TokenType::R_SQUARE) {
+                if (fields.size() != layout->fields.size()) {
                     throw ParseError(get_current_token().row, get_current_token().col, get_current_token());
                 }
-                consume_token();
-                id_n.push_back(getToken(get_current_token().row, get_current_token().col, "END", TokenType::END));
-                ASTree* expression_tree = new ASTree(id_n, var_map);
-                id_s.push_back(expression_tree->print_no_endl());
-                id_s.push_back("]");
-                pos = expression_tree->evaluate();
-                if (pos.type_tag != "double") {
-                    throw EvaluationError("index is not a number.");
-                }
-                if (pos.Double < 0 || pos.Double >= id_s.size()) {
-                    throw EvaluationError("index out of bounds.");
+            } catch (const ParseError& e) {
+                for (ASTNode* field : fields) {
+                    delete field;
                 }
-                delete expression_tree;
-                return new ArrayNode(temp_row, temp_col, node, pos, id_s, name);
+                throw e;
             }
+            consume_token();
+            return new RecordNode(temp_row, temp_col, layout, fields);
+        } else if (get_current_token().type == TokenType::VARIABLES) {
+            ASTNode* node = new IdentifierNode(get_current_token().row, get_current_token().col, get_current_token().text);
+            consume_token();
             return node;
         } else if (get_current_token().type == TokenType::BOOLEAN) {
             ASTNode* node = new BooleanNode(get_current_token().row, get_current_token().col, get_current_token().text);
             consume_token();
             return node;
+        } else if (get_current_token().type == TokenType::L_CURLY) {
+            int temp_row = get_current_token().row;
+            int temp_col = get_current_token().col;
+            consume_token();
+            std::vector<ASTNode*> keys;
+            std::vector<ASTNode*> values;
+            try {
+                while (get_current_token().type != TokenType::R_CURLY) {
+                    if (!keys.empty()) {
+                        if (get_current_token().type != TokenType::COMMA) {
+                            throw ParseError(get_current_token().row, get_current_token().col, get_current_token());
+                        }
+                        consume_token();
+                    }
+                    keys.push_back(parse_expression()->fold());
+                    if (get_current_token().type != TokenType::COLON) {
+                        throw ParseError(get_current_token().row, get_current_token().col, get_current_token());
+                    }
+                    consume_token();
+                    values.push_back(parse_expression()->fold());
+                }
+            } catch (const ParseError& e) {
+                for (ASTNode* key : keys) {
+                    delete key;
+                }
+                for (ASTNode* value : values) {
+                    delete value;
+                }
+                throw e;
+            }
+            consume_token();
+            return new DictNode(temp_row, temp_col, keys, values);
         } else if (get_current_token().type == TokenType::L_SQUARE) {
             std::vector<value_bd> array = {};
             std::vector<std::string> array_ele = {};
@@ -963,4 +1649,3 @@ ASTNode* ASTree::parse_factor() {
         throw e;
     }
 }
-
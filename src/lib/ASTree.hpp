@@ -6,13 +6,20 @@
 #include <string>
 #include <stdexcept>
 #include <unordered_map>
+#include <memory>
 #include <cmath> //fmod in modulo
+#include <type_traits>
 
 #include "lex.h" //token, TokenType defined here
 #include "errors.h"//error classes defined here
 #include "value_bd.hpp"
 
 
+// What type inference (IRProgram::infer_types) proved every value of a node
+// to be. A node proven to hold numbers or bools can be evaluated unboxed by
+// its parent, through evaluate_double or evaluate_bool.
+enum class ProvenType : unsigned char { Unknown, Double, Bool, Array };
+
 // Base class for AST nodes
 class ASTNode {
 protected:
@@ -20,27 +27,49 @@ protected:
     int column;
 
 public:
+    ProvenType proven = ProvenType::Unknown;
+
     ASTNode(int l, int c);
     virtual ~ASTNode();
 
     virtual value_bd evaluate(std::unordered_map<std::string, value_bd>*);
+    // only called on nodes proven Double or Bool; the default unpacks evaluate()
+    virtual double evaluate_double(std::unordered_map<std::string, value_bd>* var_map) {return evaluate(var_map).Double;}
+    virtual bool evaluate_bool(std::unordered_map<std::string, value_bd>* var_map) {return evaluate(var_map).Bool;}
+    bool evaluate_condition(std::unordered_map<std::string, value_bd>* var_map); //throws unless the value is a bool
     virtual std::string print();
+    virtual ASTNode* fold();                //returns the node to use in place of this one
+    virtual bool is_constant() {return false;}
+    virtual std::vector<ASTNode**> children() {return {};} //used by the optimizer to walk and rewrite the tree
+    virtual ASTNode* clone() {return nullptr;}  //deep copy, nullptr for nodes that cannot be copied
+    virtual bool short_circuit() {return false;} //only the first child is always evaluated
 };
 
+// Literals are converted once at parse time; text keeps what print() shows
 class NumberNode : public ASTNode {
 public:
-    std::string value;
+    value_bd value;
+    std::string text;
     explicit NumberNode(int line, int column, const std::string& value);
+    NumberNode(int line, int column, double value, const std::string& text);
     value_bd evaluate(std::unordered_map<std::string, value_bd>*);
+    double evaluate_double(std::unordered_map<std::string, value_bd>*) {return value.Double;}
     std::string print();
+    bool is_constant() {return true;}
+    ASTNode* clone() {return new NumberNode(line, column, value.Double, text);}
 };
 
 class BooleanNode : public ASTNode {
 public:
-    std::string value;
+    value_bd value;
+    std::string text;
     explicit BooleanNode(int line, int column, const std::string& value);
+    BooleanNode(int line, int column, bool value, const std::string& text);
     value_bd evaluate(std::unordered_map<std::string, value_bd>*);
+    bool evaluate_bool(std::unordered_map<std::string, value_bd>*) {return value.Bool;}
     std::string print();
+    bool is_constant() {return true;}
+    ASTNode* clone() {return new BooleanNode(line, column, value.Bool, text);}
 };
 
 class IdentifierNode : public ASTNode {
@@ -49,6 +78,9 @@ public:
     explicit IdentifierNode(int line, int column, const std::string& name);
     std::string print();
     value_bd evaluate(std::unordered_map<std::string, value_bd>* var_map);
+    double evaluate_double(std::unordered_map<std::string, value_bd>* var_map);
+    bool evaluate_bool(std::unordered_map<std::string, value_bd>* var_map);
+    ASTNode* clone() {return new IdentifierNode(line, column, name);}
 };
 
 class AssignmentNode : public ASTNode {
@@ -58,153 +90,534 @@ public:
     AssignmentNode(int line, int column, ASTNode* id, ASTNode* value);
     ~AssignmentNode();
     value_bd evaluate(std::unordered_map<std::string, value_bd>* var_map);
+    double evaluate_double(std::unordered_map<std::string, value_bd>* var_map);
+    bool evaluate_bool(std::unordered_map<std::string, value_bd>* var_map);
     std::string print();
+    ASTNode* fold();
+    std::vector<ASTNode**> children() {return {&id, &value};}
+    ASTNode* clone();
 };
 
-class AdditionNode : public ASTNode {
+// Shared base of the binary operators, folds itself when both sides are literals
+class OperatorNode : public ASTNode {
 public:
     ASTNode *left, *right;
-    AdditionNode(int line, int column, ASTNode* left, ASTNode* right);
-    ~AdditionNode();
-    value_bd evaluate(std::unordered_map<std::string, value_bd>* var_map);
-    std::string print();
+    OperatorNode(int line, int column, ASTNode* left, ASTNode* right);
+    ~OperatorNode();
+    ASTNode* fold();
+    std::vector<ASTNode**> children() {return {&left, &right};}
+protected:
+    template <class T> ASTNode* clone_as() {
+        ASTNode* l = left->clone();
+        ASTNode* r = right->clone();
+        if (l == nullptr || r == nullptr) {
+            delete l;
+            delete r;
+            return nullptr;
+        }
+        return new T(line, column, l, r);
+    }
+};
+
+// Operations of BinaryNode. check() validates an operand as soon as it is
+// evaluated, so the right side is not evaluated after a bad left side, and
+// apply() computes the result from two checked operands. kernel() is the
+// operation on plain values, shared with apply_batch. An operation that
+// short-circuits skips the right side when decides() is true for the left
+// one, which is then the result.
+//
+// When both operands are proven to be of type `proven`, the operation runs
+// on plain `operand` values instead: unboxed() is apply() without the checks
+// that the proof makes unnecessary, returning a plain `result`.
+struct NoShortCircuit {
+    static constexpr bool short_circuit = false;
+    template <class T> static bool decides(const T&) {return false;}
+};
+
+struct NumberOperands : NoShortCircuit {
+    typedef double operand;
+    static constexpr ProvenType proven = ProvenType::Double;
+    static void check(const value_bd& operand) {
+        if (operand.type_tag == "bool") {
+            throw EvaluationError("invalid operand type.");
+        }
+    }
+};
+
+struct BoolOperands : NoShortCircuit {
+    typedef bool operand;
+    static constexpr ProvenType proven = ProvenType::Bool;
+    static void check(const value_bd& operand) {
+        if (operand.type_tag != "bool") {
+            throw EvaluationError("invalid operand type.");
+        }
+    }
+};
+
+// unboxed only when both sides are numbers
+struct AnyOperands : NoShortCircuit {
+    typedef double operand;
+    static constexpr ProvenType proven = ProvenType::Double;
+    static void check(const value_bd&) {}
+};
+
+template <class Op> struct Arithmetic : NumberOperands {
+    typedef double result;
+    static double unboxed(double a, double b) {return Op::kernel(a, b);}
+    static value_bd apply(const value_bd& l, const value_bd& r) {return value_bd("double", Op::kernel(l.Double, r.Double));}
+};
+
+template <class Op> struct Comparison : NumberOperands {
+    typedef bool result;
+    static bool unboxed(double a, double b) {return Op::kernel(a, b);}
+    static value_bd apply(const value_bd& l, const value_bd& r) {return value_bd("bool", Op::kernel(l.Double, r.Double));}
+};
+
+template <class Op> struct Logical : BoolOperands {
+    typedef bool result;
+    static bool unboxed(bool a, bool b) {return Op::kernel(a, b);}
+    static value_bd apply(const value_bd& l, const value_bd& r) {return value_bd("bool", Op::kernel(l.Bool, r.Bool));}
+};
+
+struct AddOp : Arithmetic<AddOp> {
+    static constexpr const char* symbol = "+";
+    static double kernel(double a, double b) {return a + b;}
+};
+
+struct SubtractOp : Arithmetic<SubtractOp> {
+    static constexpr const char* symbol = "-";
+    static double kernel(double a, double b) {return a - b;}
+};
+
+struct MultiplyOp : Arithmetic<MultiplyOp> {
+    static constexpr const char* symbol = "*";
+    static double kernel(double a, double b) {return a * b;}
 };
 
-class SubtractionNode : public ASTNode {
+struct DivideOp : NumberOperands {
+    typedef double result;
+    static constexpr const char* symbol = "/";
+    static double kernel(double a, double b) {return a / b;}
+    static double unboxed(double a, double b) {
+        if (b == 0.0) {
+            throw EvaluationError("division by zero.");
+        }
+        return kernel(a, b);
+    }
+    static value_bd apply(const value_bd& l, const value_bd& r) {return value_bd("double", unboxed(l.Double, r.Double));}
+};
+
+struct ModuloOp : NumberOperands {
+    typedef double result;
+    static constexpr const char* symbol = "%";
+    static double kernel(double a, double b) {return std::fmod(a, b);}
+    static double unboxed(double a, double b) {
+        if (b == 0.0) {
+            throw EvaluationError("division by zero.");
+        }
+        return kernel(a, b);
+    }
+    static value_bd apply(const value_bd& l, const value_bd& r) {return value_bd("double", unboxed(l.Double, r.Double));}
+};
+
+struct LessOp : Comparison<LessOp> {
+    static constexpr const char* symbol = "<";
+    static bool kernel(double a, double b) {return a < b;}
+};
+
+struct LessEqualOp : Comparison<LessEqualOp> {
+    static constexpr const char* symbol = "<=";
+    static bool kernel(double a, double b) {return a <= b;}
+};
+
+struct MoreOp : Comparison<MoreOp> {
+    static constexpr const char* symbol = ">";
+    static bool kernel(double a, double b) {return a > b;}
+};
+
+struct MoreEqualOp : Comparison<MoreEqualOp> {
+    static constexpr const char* symbol = ">=";
+    static bool kernel(double a, double b) {return a >= b;}
+};
+
+// Values of different types are never equal. Arrays are equal when they have
+// the same length and equal elements, compared in place down nested arrays;
+// matrices also need the same number of columns.
+bool equal_values(const value_bd& l, const value_bd& r);
+
+struct EqualOp : AnyOperands {
+    typedef bool result;
+    static constexpr const char* symbol = "==";
+    static bool kernel(double a, double b) {return a == b;}
+    static bool unboxed(double a, double b) {return kernel(a, b);}
+    static value_bd apply(const value_bd& l, const value_bd& r) {return value_bd("bool", equal_values(l, r));}
+};
+
+struct NotEqualOp : AnyOperands {
+    typedef bool result;
+    static constexpr const char* symbol = "!=";
+    static bool kernel(double a, double b) {return a != b;}
+    static bool unboxed(double a, double b) {return kernel(a, b);}
+    static value_bd apply(const value_bd& l, const value_bd& r) {return value_bd("bool", !equal_values(l, r));}
+};
+
+struct LandOp : Logical<LandOp> {
+    static constexpr const char* symbol = "&";
+    static constexpr bool short_circuit = true;
+    static bool decides(const value_bd& l) {return !l.Bool;}
+    static bool decides(bool l) {return !l;}
+    static bool kernel(bool a, bool b) {return a && b;}
+};
+
+struct LxorOp : Logical<LxorOp> {
+    static constexpr const char* symbol = "^";
+    static bool kernel(bool a, bool b) {return a != b;}
+};
+
+struct LorOp : Logical<LorOp> {
+    static constexpr const char* symbol = "|";
+    static constexpr bool short_circuit = true;
+    static bool decides(const value_bd& l) {return l.Bool;}
+    static bool decides(bool l) {return l;}
+    static bool kernel(bool a, bool b) {return a || b;}
+};
+
+inline double unbox(ASTNode* node, std::unordered_map<std::string, value_bd>* var_map, double) {return node->evaluate_double(var_map);}
+inline bool unbox(ASTNode* node, std::unordered_map<std::string, value_bd>* var_map, bool) {return node->evaluate_bool(var_map);}
+
+// All binary operators. Each operand is evaluated once, left to right, and
+// the operation is resolved at compile time so it is inlined into evaluate.
+template <class Op>
+class BinaryNode : public OperatorNode {
+    typedef typename Op::operand Operand;
+    typedef typename Op::result Result;
+    bool unboxed_operands() const {return left->proven == Op::proven && right->proven == Op::proven;}
+    Result unboxed(std::unordered_map<std::string, value_bd>* var_map) {
+        Operand l = unbox(left, var_map, Operand());
+        if (Op::short_circuit && Op::decides(l)) {
+            return l;
+        }
+        return Op::unboxed(l, unbox(right, var_map, Operand()));
+    }
 public:
-    ASTNode *left, *right;
-    SubtractionNode(int line, int column, ASTNode* left, ASTNode* right);
-    ~SubtractionNode();
-    value_bd evaluate(std::unordered_map<std::string, value_bd>* var_map);
-    std::string print();
+    BinaryNode(int line, int column, ASTNode* left, ASTNode* right) : OperatorNode(line, column, left, right) {}
+    value_bd evaluate(std::unordered_map<std::string, value_bd>* var_map) {
+        if (unboxed_operands()) {
+            return value_bd(std::is_same<Result, bool>::value ? "bool" : "double", unboxed(var_map));
+        }
+        value_bd l = left->evaluate(var_map);
+        Op::check(l);
+        if (Op::short_circuit && Op::decides(l)) {
+            return l;
+        }
+        value_bd r = right->evaluate(var_map);
+        Op::check(r);
+        return Op::apply(l, r);
+    }
+    double evaluate_double(std::unordered_map<std::string, value_bd>* var_map) {
+        return unboxed_operands() ? unboxed(var_map) : evaluate(var_map).Double;
+    }
+    bool evaluate_bool(std::unordered_map<std::string, value_bd>* var_map) {
+        return unboxed_operands() ? unboxed(var_map) : evaluate(var_map).Bool;
+    }
+    std::string print() {return "(" + left->print() + " " + Op::symbol + " " + right->print() + ")";}
+    ASTNode* clone() {return clone_as<BinaryNode<Op>>();}
+    bool short_circuit() {return Op::short_circuit;}
+    ASTNode* fold() {
+        if (Op::short_circuit) {
+            left = left->fold();
+            BooleanNode* decided = dynamic_cast<BooleanNode*>(left);
+            if (decided != nullptr && Op::decides(decided->value)) {
+                ASTNode* literal = new BooleanNode(line, column, decided->value.Bool, print());
+                delete this;
+                return literal;
+            }
+        }
+        return OperatorNode::fold();
+    }
 };
 
-class MultiplicationNode : public ASTNode {
+typedef BinaryNode<AddOp>       AdditionNode;
+typedef BinaryNode<SubtractOp>  SubtractionNode;
+typedef BinaryNode<MultiplyOp>  MultiplicationNode;
+typedef BinaryNode<DivideOp>    DivisionNode;
+typedef BinaryNode<ModuloOp>    ModuloNode;
+typedef BinaryNode<LessOp>      LessNode;
+typedef BinaryNode<LessEqualOp> LessEqualNode;
+typedef BinaryNode<MoreOp>      MoreNode;
+typedef BinaryNode<MoreEqualOp> MoreEqualNode;
+typedef BinaryNode<EqualOp>     EqualNode;
+typedef BinaryNode<NotEqualOp>  NotEqualNode;
+typedef BinaryNode<LandOp>      LandNode;
+typedef BinaryNode<LxorOp>      LxorNode;
+typedef BinaryNode<LorOp>       LorNode;
+
+// Element by element form of an operation, for code working on whole arrays
+// of numbers. Division and modulo do not check for zero here.
+template <class Op, class T, class R>
+void apply_batch(const T* a, const T* b, R* out, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        out[i] = Op::kernel(a[i], b[i]);
+    }
+}
+
+// cond ? taken : other, evaluates the condition and then only the operand it selects
+class ConditionalNode : public ASTNode {
 public:
-    ASTNode *left, *right;
-    MultiplicationNode(int line, int column, ASTNode* left, ASTNode* right);
-    ~MultiplicationNode();
+    ASTNode *condition, *taken, *other;
+    ConditionalNode(int line, int column, ASTNode* condition, ASTNode* taken, ASTNode* other);
+    ~ConditionalNode();
     value_bd evaluate(std::unordered_map<std::string, value_bd>* var_map);
+    double evaluate_double(std::unordered_map<std::string, value_bd>* var_map);
+    bool evaluate_bool(std::unordered_map<std::string, value_bd>* var_map);
     std::string print();
+    ASTNode* fold();
+    std::vector<ASTNode**> children() {return {&condition, &taken, &other};}
+    ASTNode* clone();
+    bool short_circuit() {return true;}
+};
+
+// Shared by the element accesses that a loop's bounds guard covers (see
+// BoundsGuard). The loop sets it on entry when the guard proves every index
+// those accesses can see is in range, and they skip their own checks.
+struct BoundsCheck {
+    bool proven = false;
 };
 
-class DivisionNode : public ASTNode {
+class ArrayNode : public ASTNode {
 public:
-    ASTNode *left, *right;
-    DivisionNode(int line, int column, ASTNode* left, ASTNode* right);
-    ~DivisionNode();
+    std::vector<std::string> array_ele;
+    std::string name;
+    value_bd value;                 //the literal as evaluated, packed when it can be
+    ArrayNode(int line, int column, std::vector<value_bd> array, std::vector<std::string> array_ele, std::string name);
+    ArrayNode(int line, int column, std::vector<value_bd> array);
     value_bd evaluate(std::unordered_map<std::string, value_bd>* var_map);
     std::string print();
+    std::string evaluate_print(std::vector<value_bd> arr);
+    std::string evaluate_print_dict(const value_bd& dict);
+    ASTNode* clone() {return new ArrayNode(line, column, value.elements(), array_ele, name);}
 };
 
-class ModuloNode : public ASTNode {
+// base[index], with both evaluated every time. When the base is a variable
+// (or an element of one, for a[i][j]) the array is read and written where it
+// sits in the map, so neither a read nor a write copies it.
+class IndexNode : public ASTNode {
 public:
-    ASTNode *left, *right;
-    ModuloNode(int line, int column, ASTNode* left, ASTNode* right);
-    ~ModuloNode();
+    ASTNode* base;
+    ASTNode* index;
+    std::string name;               //variable at the root of the base, empty when it is not one
+    bool by_name;                   //base is that variable itself
+    std::shared_ptr<BoundsCheck> bounds;
+    IndexNode(int line, int column, ASTNode* base, ASTNode* index);
+    ~IndexNode();
     value_bd evaluate(std::unordered_map<std::string, value_bd>* var_map);
-    std::string print();
+    double evaluate_double(std::unordered_map<std::string, value_bd>* var_map);
+    bool evaluate_bool(std::unordered_map<std::string, value_bd>* var_map);
+    virtual value_bd* locate(std::unordered_map<std::string, value_bd>* var_map, size_t& position, bool nested = false); //array and position written by an assignment
+    void assign(std::unordered_map<std::string, value_bd>* var_map, const value_bd& value);
+    std::string print() {return base->print() + "[" + index->print() + "]";}
+    std::vector<ASTNode**> children() {return {&base, &index};}
+    ASTNode* clone();
+private:
+    friend class FieldNode;
+    virtual const value_bd& container(std::unordered_map<std::string, value_bd>* var_map, value_bd& scratch, size_t& position, bool& row);
+};
+
+// The fields of a record type, `record Point(x, y);`. A record value keeps
+// its fields in value_bd::array in this order. Layouts are made when the
+// declaration is parsed and live as long as the program; declaring a name
+// again gives it a new layout and leaves the values made with the old one.
+struct RecordLayout {
+    std::string name;
+    std::vector<std::string> fields;
+    size_t slot(const std::string& field) const;    //fields.size() when there is none
+    static const RecordLayout* declare(const std::string& name, const std::vector<std::string>& fields);
+    static const RecordLayout* find(const std::string& name);
 };
 
-class LessNode : public ASTNode {
+// base.field, an IndexNode whose position is the field's slot (and which has
+// no index). The slot is looked up once per layout the base is seen with, so
+// after the first read a field is read at a fixed position. Reads and writes
+// go through the same paths as elements: p.x = v, a[i].x, p.v[j] = w.
+class FieldNode : public IndexNode {
 public:
-    ASTNode *left, *right;
-    LessNode(int line, int column, ASTNode* left, ASTNode* right);
-    ~LessNode();
+    std::string field;
+    FieldNode(int line, int column, ASTNode* base, const std::string& field);
+    value_bd* locate(std::unordered_map<std::string, value_bd>* var_map, size_t& position, bool nested = false);
+    std::string print() {return base->print() + "." + field;}
+    std::vector<ASTNode**> children() {return {&base};}
+    ASTNode* clone();
+private:
+    const RecordLayout* cached = nullptr;
+    size_t cached_slot = 0;
+    size_t slot_in(const value_bd& record);
+    const value_bd& container(std::unordered_map<std::string, value_bd>* var_map, value_bd& scratch, size_t& position, bool& row);
+};
+
+// Point(1, 2): a new record with the fields in the order they were declared
+class RecordNode : public ASTNode {
+public:
+    const RecordLayout* layout;
+    std::vector<ASTNode*> fields;
+    RecordNode(int line, int column, const RecordLayout* layout, std::vector<ASTNode*> fields);
+    ~RecordNode();
     value_bd evaluate(std::unordered_map<std::string, value_bd>* var_map);
     std::string print();
+    std::vector<ASTNode**> children();
+    ASTNode* clone();
 };
 
-class LessEqualNode : public ASTNode {
+// The declaration itself, kept in the tree so it is printed; the layout was
+// made when it was parsed and running it does nothing
+class RecordDeclNode : public ASTNode {
 public:
-    ASTNode *left, *right;
-    LessEqualNode(int line, int column, ASTNode* left, ASTNode* right);
-    ~LessEqualNode();
-    value_bd evaluate(std::unordered_map<std::string, value_bd>* var_map);
+    const RecordLayout* layout;
+    RecordDeclNode(int line, int column, const RecordLayout* layout) : ASTNode(line, column), layout(layout) {}
+    value_bd evaluate(std::unordered_map<std::string, value_bd>*) {return value_bd();}
     std::string print();
+    ASTNode* clone() {return new RecordDeclNode(line, column, layout);}
 };
 
-class MoreNode : public ASTNode {
+// base[from:to], the elements from up to but not including to; a bound left
+// out is the start or the end. A slice of a packed array is a view of the same
+// elements (value_bd::range), so taking one costs the same at any length.
+class SliceNode : public ASTNode {
 public:
-    ASTNode *left, *right;
-    MoreNode(int line, int column, ASTNode* left, ASTNode* right);
-    ~MoreNode();
+    ASTNode* base;
+    ASTNode* from;                  //nullptr for the start
+    ASTNode* to;                    //nullptr for the end
+    std::string name;               //variable sliced, empty when the base is not one
+    SliceNode(int line, int column, ASTNode* base, ASTNode* from, ASTNode* to);
+    ~SliceNode();
     value_bd evaluate(std::unordered_map<std::string, value_bd>* var_map);
     std::string print();
+    std::vector<ASTNode**> children();
+    ASTNode* clone();
 };
 
-class MoreEqualNode : public ASTNode {
+// from..to in the header of a for loop, the numbers from up to but not
+// including to. It is never made into an array: the loop reads the bounds
+// and counts itself, so a range on its own has no value.
+class RangeNode : public ASTNode {
 public:
-    ASTNode *left, *right;
-    MoreEqualNode(int line, int column, ASTNode* left, ASTNode* right);
-    ~MoreEqualNode();
+    ASTNode* from;
+    ASTNode* to;
+    RangeNode(int line, int column, ASTNode* from, ASTNode* to) : ASTNode(line, column), from(from), to(to) {}
+    ~RangeNode();
     value_bd evaluate(std::unordered_map<std::string, value_bd>* var_map);
-    std::string print();
+    ASTNode* fold();
+    std::string print() {return from->print() + ".." + to->print();}
+    std::vector<ASTNode**> children() {return {&from, &to};}
+    ASTNode* clone();
 };
 
-class EqualNode : public ASTNode {
+// {key: value, ...}, a new dictionary each time it is evaluated. Each key is
+// evaluated before its value, entries left to right; a key given twice keeps
+// the later value.
+class DictNode : public ASTNode {
 public:
-    ASTNode *left, *right;
-    EqualNode(int line, int column, ASTNode* left, ASTNode* right);
-    ~EqualNode();
+    std::vector<ASTNode*> keys;
+    std::vector<ASTNode*> values;
+    DictNode(int line, int column, std::vector<ASTNode*> keys, std::vector<ASTNode*> values);
+    ~DictNode();
     value_bd evaluate(std::unordered_map<std::string, value_bd>* var_map);
     std::string print();
+    std::vector<ASTNode**> children();
+    ASTNode* clone();
 };
 
-class NotEqualNode : public ASTNode {
+// Hidden temporaries introduced by the optimizer: the store node computes an
+// expression once and keeps it in a slot, the load nodes reuse that value
+class TempStoreNode : public ASTNode {
 public:
-    ASTNode *left, *right;
-    NotEqualNode(int line, int column, ASTNode* left, ASTNode* right);
-    ~NotEqualNode();
+    std::shared_ptr<value_bd> slot;
+    std::string name;
+    ASTNode* expression;
+    TempStoreNode(std::shared_ptr<value_bd> slot, std::string name, ASTNode* expression);
+    ~TempStoreNode();
     value_bd evaluate(std::unordered_map<std::string, value_bd>* var_map);
     std::string print();
+    std::vector<ASTNode**> children() {return {&expression};}
 };
 
-class LandNode : public ASTNode {
+class TempLoadNode : public ASTNode {
 public:
-    ASTNode *left, *right;
-    LandNode(int line, int column, ASTNode* left, ASTNode* right);
-    ~LandNode();
+    std::shared_ptr<value_bd> slot;
+    std::string name;
+    TempLoadNode(std::shared_ptr<value_bd> slot, std::string name);
     value_bd evaluate(std::unordered_map<std::string, value_bd>* var_map);
+    double evaluate_double(std::unordered_map<std::string, value_bd>*) {return slot->Double;}
+    bool evaluate_bool(std::unordered_map<std::string, value_bd>*) {return slot->Bool;}
     std::string print();
 };
 
-class LxorNode : public ASTNode {
+
+// Loop-invariant subexpression hoisted out of a while loop. The value is
+// computed the first time the loop reaches it and reused until the loop is
+// entered again, so a loop that never runs never evaluates it. Repeated
+// occurrences in the same loop share one cache.
+struct InvariantCache {
+    bool cached = false;
+    value_bd value;
+};
+
+class InvariantNode : public ASTNode {
 public:
-    ASTNode *left, *right;
-    LxorNode(int line, int column, ASTNode* left, ASTNode* right);
-    ~LxorNode();
+    std::string name;
+    ASTNode* expression;
+    std::shared_ptr<InvariantCache> cache;
+    InvariantNode(std::string name, ASTNode* expression, std::shared_ptr<InvariantCache> cache);
+    ~InvariantNode();
     value_bd evaluate(std::unordered_map<std::string, value_bd>* var_map);
+    double evaluate_double(std::unordered_map<std::string, value_bd>* var_map);
     std::string print();
 };
 
-class LorNode : public ASTNode {
+// Product of an induction variable and a loop-invariant factor. Once it has
+// been computed with exact integer operands it is kept up to date by the
+// InductionStepNode that increments the variable, instead of multiplying again.
+struct ReducedProduct {
+    std::string name;
+    double increment;
+    bool valid = false;
+    double value = 0;
+    double step = 0;
+};
+
+class ReducedProductNode : public ASTNode {
 public:
-    ASTNode *left, *right;
-    LorNode(int line, int column, ASTNode* left, ASTNode* right);
-    ~LorNode();
+    MultiplicationNode* product;
+    ASTNode* variable;
+    ASTNode* factor;
+    std::shared_ptr<ReducedProduct> state;
+    ReducedProductNode(MultiplicationNode* product, bool variable_on_left, std::shared_ptr<ReducedProduct> state);
+    ~ReducedProductNode();
+    double evaluate_double(std::unordered_map<std::string, value_bd>* var_map) {return state->valid ? state->value : evaluate(var_map).Double;}
     value_bd evaluate(std::unordered_map<std::string, value_bd>* var_map);
     std::string print();
 };
 
-class ArrayNode : public ASTNode {
+class InductionStepNode : public ASTNode {
 public:
-    ASTNode* node;
-    std::vector<value_bd> array;
-    std::vector<std::string> array_ele;
-    value_bd position;
-    std::string name;
-    ArrayNode(int line, int column, std::vector<value_bd> array, std::vector<std::string> array_ele, std::string name);
-    ArrayNode(int line, int column, ASTNode* node, value_bd position, std::vector<std::string> array_ele, std::string name);
-    ArrayNode(int line, int column, std::vector<value_bd> array);
-    ~ArrayNode();
+    ASTNode* assignment;
+    std::vector<ReducedProductNode*> products; //first occurrence of each product, owned by the tree
+    InductionStepNode(ASTNode* assignment, std::vector<ReducedProductNode*> products);
+    ~InductionStepNode();
     value_bd evaluate(std::unordered_map<std::string, value_bd>* var_map);
     std::string print();
-    std::string evaluate_print(std::vector<value_bd> arr);
+    std::vector<ASTNode**> children() {return {&assignment};}
 };
 
-
 class ASTree {
+    friend class Optimizer;
+    friend class IRProgram;
+    friend class FuncNode;
+    friend class IfNode;
+    friend class ForNode;
+    friend struct function_call;
+    friend class STree;
+    friend class EXP;
+    friend class ExpressionNode;
     std::vector<token> tokens;
     size_t current_token_index = 0;
     ASTNode* head = nullptr;
@@ -215,6 +628,7 @@ class ASTree {
     
     ASTNode* parse_expression();
     ASTNode* parse_assignment();
+    ASTNode* parse_conditional();
     ASTNode* parse_Lor();
     ASTNode* parse_Lxor();
     ASTNode* parse_Land();
@@ -223,11 +637,16 @@ class ASTree {
     ASTNode* parse_addition_subtraction();
     ASTNode* parse_multiplication_division_modulo();
     ASTNode* parse_factor();
+    ASTNode* parse_primary();
 
 public:
     
     ASTree(const std::vector<token>& Tokens, std::unordered_map<std::string, value_bd>* map);
+    ASTree(ASTNode* head, std::unordered_map<std::string, value_bd>* map); //for trees built by the optimizer
     value_bd evaluate();
+    value_bd evaluate(std::unordered_map<std::string, value_bd>* map);
+    bool evaluate_condition(std::unordered_map<std::string, value_bd>* map) {return head->evaluate_condition(map);}
+    void evaluate_statement(std::unordered_map<std::string, value_bd>* map); //for effects only, a proven result is not boxed
     void print();
     std::string print_no_endl();
     ~ASTree();
@@ -0,0 +1,710 @@
+#include "Builtins.hpp"
+#include "ASTree.hpp"
+#include "Dictionary.hpp"
+#include "Collections.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+//----------------------
+
+// Kernels over plain numbers. The SSE2 loops and the plain ones combine the
+// elements in the same order, so results do not depend on how scrypt was
+// built: element i goes to lane i % 4, the lanes are combined as (0 with 2)
+// with (1 with 3), and the elements left over are taken one by one.
+
+static double sum_numbers(const double* data, size_t count){
+    double lanes[4] = {0, 0, 0, 0};
+    size_t i = 0;
+#ifdef __SSE2__
+    __m128d low = _mm_setzero_pd();
+    __m128d high = _mm_setzero_pd();
+    for (; i + 4 <= count; i += 4) {
+        low = _mm_add_pd(low, _mm_loadu_pd(data + i));
+        high = _mm_add_pd(high, _mm_loadu_pd(data + i + 2));
+    }
+    _mm_storeu_pd(lanes, low);
+    _mm_storeu_pd(lanes + 2, high);
+#else
+    for (; i + 4 <= count; i += 4) {
+        lanes[0] += data[i];
+        lanes[1] += data[i + 1];
+        lanes[2] += data[i + 2];
+        lanes[3] += data[i + 3];
+    }
+#endif
+    double total = (lanes[0] + lanes[2]) + (lanes[1] + lanes[3]);
+    for (; i < count; i++) {
+        total += data[i];
+    }
+    return total;
+}
+
+static double dot_numbers(const double* a, const double* b, size_t count){
+    double lanes[4] = {0, 0, 0, 0};
+    size_t i = 0;
+#ifdef __SSE2__
+    __m128d low = _mm_setzero_pd();
+    __m128d high = _mm_setzero_pd();
+    for (; i + 4 <= count; i += 4) {
+        low = _mm_add_pd(low, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+        high = _mm_add_pd(high, _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+    }
+    _mm_storeu_pd(lanes, low);
+    _mm_storeu_pd(lanes + 2, high);
+#else
+    for (; i + 4 <= count; i += 4) {
+        lanes[0] += a[i] * b[i];
+        lanes[1] += a[i + 1] * b[i + 1];
+        lanes[2] += a[i + 2] * b[i + 2];
+        lanes[3] += a[i + 3] * b[i + 3];
+    }
+#endif
+    double total = (lanes[0] + lanes[2]) + (lanes[1] + lanes[3]);
+    for (; i < count; i++) {
+        total += a[i] * b[i];
+    }
+    return total;
+}
+
+// x < m ? x : m is what MINPD computes lane by lane, so -0 and 0 come out
+// the same either way. count is at least 1.
+static double min_numbers(const double* data, size_t count){
+    if (count < 4) {
+        double least = data[0];
+        for (size_t i = 1; i < count; i++) {
+            least = data[i] < least ? data[i] : least;
+        }
+        return least;
+    }
+    double lanes[4] = {data[0], data[1], data[2], data[3]};
+    size_t i = 4;
+#ifdef __SSE2__
+    __m128d low = _mm_loadu_pd(data);
+    __m128d high = _mm_loadu_pd(data + 2);
+    for (; i + 4 <= count; i += 4) {
+        low = _mm_min_pd(_mm_loadu_pd(data + i), low);
+        high = _mm_min_pd(_mm_loadu_pd(data + i + 2), high);
+    }
+    _mm_storeu_pd(lanes, low);
+    _mm_storeu_pd(lanes + 2, high);
+#else
+    for (; i + 4 <= count; i += 4) {
+        for (size_t lane = 0; lane < 4; lane++) {
+            lanes[lane] = data[i + lane] < lanes[lane] ? data[i + lane] : lanes[lane];
+        }
+    }
+#endif
+    double even = lanes[2] < lanes[0] ? lanes[2] : lanes[0];
+    double odd = lanes[3] < lanes[1] ? lanes[3] : lanes[1];
+    double least = odd < even ? odd : even;
+    for (; i < count; i++) {
+        least = data[i] < least ? data[i] : least;
+    }
+    return least;
+}
+
+static double max_numbers(const double* data, size_t count){
+    if (count < 4) {
+        double most = data[0];
+        for (size_t i = 1; i < count; i++) {
+            most = data[i] > most ? data[i] : most;
+        }
+        return most;
+    }
+    double lanes[4] = {data[0], data[1], data[2], data[3]};
+    size_t i = 4;
+#ifdef __SSE2__
+    __m128d low = _mm_loadu_pd(data);
+    __m128d high = _mm_loadu_pd(data + 2);
+    for (; i + 4 <= count; i += 4) {
+        low = _mm_max_pd(_mm_loadu_pd(data + i), low);
+        high = _mm_max_pd(_mm_loadu_pd(data + i + 2), high);
+    }
+    _mm_storeu_pd(lanes, low);
+    _mm_storeu_pd(lanes + 2, high);
+#else
+    for (; i + 4 <= count; i += 4) {
+        for (size_t lane = 0; lane < 4; lane++) {
+            lanes[lane] = data[i + lane] > lanes[lane] ? data[i + lane] : lanes[lane];
+        }
+    }
+#endif
+    double even = lanes[2] > lanes[0] ? lanes[2] : lanes[0];
+    double odd = lanes[3] > lanes[1] ? lanes[3] : lanes[1];
+    double most = odd > even ? odd : even;
+    for (; i < count; i++) {
+        most = data[i] > most ? data[i] : most;
+    }
+    return most;
+}
+
+// position of the first element equal to value, count when there is none
+static size_t find_number(const double* data, size_t count, double value){
+    size_t i = 0;
+#ifdef __SSE2__
+    __m128d wanted = _mm_set1_pd(value);
+    for (; i + 2 <= count; i += 2) {
+        int mask = _mm_movemask_pd(_mm_cmpeq_pd(_mm_loadu_pd(data + i), wanted));
+        if (mask != 0) {
+            return (mask & 1) ? i : i + 1;
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        if (data[i] == value) {
+            return i;
+        }
+    }
+    return count;
+}
+
+// Doubles mapped to integers in the same order: negative numbers have every
+// bit flipped, the others only the sign bit. -0 sorts before 0.
+static uint64_t sort_key(double value){
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return (bits >> 63) ? ~bits : bits | (uint64_t(1) << 63);
+}
+
+static double from_sort_key(uint64_t key){
+    uint64_t bits = (key >> 63) ? key & ~(uint64_t(1) << 63) : ~key;
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Least significant digit radix sort on the keys, 16 bits per pass. A pass
+// where every key has the same digit is skipped, which for whole numbers of
+// similar size is most of them. Short arrays are not worth the counting.
+static void sort_numbers(std::vector<double>& numbers){
+    std::vector<uint64_t> keys(numbers.size());
+    for (size_t i = 0; i < numbers.size(); i++) {
+        keys[i] = sort_key(numbers[i]);
+    }
+    if (keys.size() < 256) {
+        std::sort(keys.begin(), keys.end());
+    } else {
+        std::vector<uint64_t> buffer(keys.size());
+        std::vector<size_t> counts(1 << 16);
+        for (int shift = 0; shift < 64; shift += 16) {
+            std::fill(counts.begin(), counts.end(), 0);
+            for (uint64_t key : keys) {
+                counts[(key >> shift) & 0xffff]++;
+            }
+            if (counts[(keys[0] >> shift) & 0xffff] == keys.size()) {
+                continue;
+            }
+            size_t start = 0;
+            for (size_t& count : counts) {
+                size_t next = start + count;
+                count = start;
+                start = next;
+            }
+            for (uint64_t key : keys) {
+                buffer[counts[(key >> shift) & 0xffff]++] = key;
+            }
+            keys.swap(buffer);
+        }
+    }
+    for (size_t i = 0; i < numbers.size(); i++) {
+        numbers[i] = from_sort_key(keys[i]);
+    }
+}
+
+// out[j] += scale * in[j], multiplying before adding like the plain loop
+static void add_scaled(double* out, const double* in, double scale, size_t count){
+    size_t j = 0;
+#ifdef __SSE2__
+    __m128d factor = _mm_set1_pd(scale);
+    for (; j + 2 <= count; j += 2) {
+        _mm_storeu_pd(out + j, _mm_add_pd(_mm_loadu_pd(out + j), _mm_mul_pd(factor, _mm_loadu_pd(in + j))));
+    }
+#endif
+    for (; j < count; j++) {
+        out[j] += scale * in[j];
+    }
+}
+
+// c = a b for an n x k matrix a and a k x m matrix b, all row-major. The loops
+// run i, then p over k, then j, so the innermost one walks a row of b and a
+// row of c; blocking p and j keeps the tile of b in use in cache across rows.
+// Every c[i][j] still adds its products in order of p, from 0, the same sum
+// a triple loop over i, j and p computes.
+static void multiply_blocked(const double* a, const double* b, double* c, size_t n, size_t k, size_t m){
+    const size_t block = 64;
+    std::fill(c, c + n * m, 0.0);
+    for (size_t pp = 0; pp < k; pp += block) {
+        size_t p_end = std::min(pp + block, k);
+        for (size_t jj = 0; jj < m; jj += block) {
+            size_t j_end = std::min(jj + block, m);
+            for (size_t i = 0; i < n; i++) {
+                for (size_t p = pp; p < p_end; p++) {
+                    add_scaled(c + i * m + jj, b + p * m + jj, a[i * k + p], j_end - jj);
+                }
+            }
+        }
+    }
+}
+
+// Tile by tile, so that both the rows read and the rows written stay in cache
+static void transpose_blocked(const double* in, double* out, size_t rows, size_t columns){
+    const size_t block = 32;
+    for (size_t ii = 0; ii < rows; ii += block) {
+        size_t i_end = std::min(ii + block, rows);
+        for (size_t jj = 0; jj < columns; jj += block) {
+            size_t j_end = std::min(jj + block, columns);
+            for (size_t i = ii; i < i_end; i++) {
+                for (size_t j = jj; j < j_end; j++) {
+                    out[j * rows + i] = in[i * columns + j];
+                }
+            }
+        }
+    }
+}
+
+//----------------------
+
+static value_bd& array_argument(value_bd* argument){
+    if (argument->type_tag != "array") {
+        throw EvaluationError("argument is not an array.");
+    }
+    return *argument;
+}
+
+static double number_argument(const value_bd* argument){
+    if (argument->type_tag != "double") {
+        throw EvaluationError("argument is not a number.");
+    }
+    return argument->Double;
+}
+
+// The elements of an array of numbers, read in place when it is packed
+static const double* numbers_of(const value_bd& array, std::vector<double>& scratch){
+    if (array.packed != nullptr && !array.packed->flags_only) {
+        return array.packed->numbers.data() + array.offset;
+    }
+    scratch.clear();
+    for (size_t i = 0; i < array.length(); i++) {
+        value_bd item = array.at(i);
+        if (item.type_tag != "double") {
+            throw EvaluationError("invalid operand type.");
+        }
+        scratch.push_back(item.Double);
+    }
+    return scratch.data();
+}
+
+static value_bd& dict_argument(value_bd* argument){
+    if (argument->dict == nullptr) {
+        throw EvaluationError("argument is not a dictionary.");
+    }
+    return *argument;
+}
+
+static value_bd& heap_argument(value_bd* argument){
+    if (argument->heap == nullptr) {
+        throw EvaluationError("argument is not a heap.");
+    }
+    return *argument;
+}
+
+static value_bd& deque_argument(value_bd* argument){
+    if (argument->deque == nullptr) {
+        throw EvaluationError("argument is not a deque.");
+    }
+    return *argument;
+}
+
+static const value_bd& matrix_argument(const value_bd* argument){
+    if (argument->columns == 0) {
+        throw EvaluationError("argument is not a matrix.");
+    }
+    return *argument;
+}
+
+// A rows x columns matrix of zeros
+static value_bd make_matrix(size_t rows, size_t columns){
+    std::shared_ptr<PackedArray> storage = std::make_shared<PackedArray>();
+    storage->flags_only = false;
+    storage->numbers.assign(rows * columns, 0.0);
+    value_bd result("matrix", std::vector<value_bd>());
+    result.adopt(storage);
+    result.columns = columns;
+    return result;
+}
+
+static const double* matrix_numbers(const value_bd& matrix){
+    return matrix.packed->numbers.data() + matrix.offset;
+}
+
+// the number of rows of a matrix, of entries of a dictionary or a heap, of
+// elements of an array or a deque
+static value_bd builtin_len(value_bd** arguments){
+    if (arguments[0]->columns != 0) {
+        return value_bd("double", (double)arguments[0]->rows());
+    }
+    if (arguments[0]->dict != nullptr) {
+        return value_bd("double", (double)arguments[0]->dict->size());
+    }
+    if (arguments[0]->heap != nullptr) {
+        return value_bd("double", (double)arguments[0]->heap->size());
+    }
+    if (arguments[0]->deque != nullptr) {
+        return value_bd("double", (double)arguments[0]->deque->size());
+    }
+    return value_bd("double", (double)array_argument(arguments[0]).length());
+}
+
+// push returns the new length, pop the element it removed; on a deque they
+// work at the back
+static value_bd builtin_push(value_bd** arguments){
+    if (arguments[0]->deque != nullptr) {
+        Deque& deque = Deque::own(*arguments[0]);
+        deque.push_back(*arguments[1]);
+        return value_bd("double", (double)deque.size());
+    }
+    value_bd& array = array_argument(arguments[0]);
+    array.append(*arguments[1]);
+    return value_bd("double", (double)array.length());
+}
+
+static value_bd builtin_pop(value_bd** arguments){
+    if (arguments[0]->deque != nullptr) {
+        if (arguments[0]->deque->size() == 0) {
+            throw EvaluationError("empty deque.");
+        }
+        return Deque::own(*arguments[0]).pop_back();
+    }
+    value_bd& array = array_argument(arguments[0]);
+    if (array.length() == 0) {
+        throw EvaluationError("empty array.");
+    }
+    return array.remove_last();
+}
+
+// slice(a, i, j) is a new array of the elements i up to but not including j
+static value_bd builtin_slice(value_bd** arguments){
+    const value_bd& array = array_argument(arguments[0]);
+    double from = number_argument(arguments[1]);
+    double to = number_argument(arguments[2]);
+    if (from < 0 || to < from || to > array.length()) {
+        throw EvaluationError("index out of bounds. really?");
+    }
+    return array.range((size_t)from, (size_t)to);
+}
+
+// fill(a, v) sets every element of a to v
+static value_bd builtin_fill(value_bd** arguments){
+    value_bd& array = array_argument(arguments[0]);
+    const value_bd& value = *arguments[1];
+    size_t count = array.length();
+    if (count != 0 && (value.type_tag == "double" || value.type_tag == "bool")) {
+        std::shared_ptr<PackedArray> storage = std::make_shared<PackedArray>();
+        storage->flags_only = value.type_tag == "bool";
+        if (storage->flags_only) {
+            storage->flags.assign(count, value.Bool);
+        } else {
+            storage->numbers.assign(count, value.Double);
+        }
+        array.adopt(storage);
+    } else {
+        array.unpack();
+        std::fill(array.array.begin(), array.array.end(), value);
+    }
+    return value_bd();
+}
+
+static value_bd builtin_sum(value_bd** arguments){
+    const value_bd& array = array_argument(arguments[0]);
+    std::vector<double> scratch;
+    const double* numbers = numbers_of(array, scratch);
+    return value_bd("double", sum_numbers(numbers, array.length()));
+}
+
+static value_bd builtin_min(value_bd** arguments){
+    const value_bd& array = array_argument(arguments[0]);
+    std::vector<double> scratch;
+    const double* numbers = numbers_of(array, scratch);
+    if (array.length() == 0) {
+        throw EvaluationError("empty array.");
+    }
+    return value_bd("double", min_numbers(numbers, array.length()));
+}
+
+static value_bd builtin_max(value_bd** arguments){
+    const value_bd& array = array_argument(arguments[0]);
+    std::vector<double> scratch;
+    const double* numbers = numbers_of(array, scratch);
+    if (array.length() == 0) {
+        throw EvaluationError("empty array.");
+    }
+    return value_bd("double", max_numbers(numbers, array.length()));
+}
+
+static value_bd builtin_dot(value_bd** arguments){
+    const value_bd& a = array_argument(arguments[0]);
+    const value_bd& b = array_argument(arguments[1]);
+    if (a.length() != b.length()) {
+        throw EvaluationError("arrays differ in length.");
+    }
+    std::vector<double> scratch_a;
+    std::vector<double> scratch_b;
+    const double* left = numbers_of(a, scratch_a);
+    const double* right = numbers_of(b, scratch_b);
+    return value_bd("double", dot_numbers(left, right, a.length()));
+}
+
+// Sorts numbers ascending, or bools with false first; other elements fail
+static value_bd builtin_sort(value_bd** arguments){
+    value_bd& array = array_argument(arguments[0]);
+    if (array.packed != nullptr && array.packed->flags_only) {
+        array.unshare();
+        std::vector<bool>& flags = array.packed->flags;
+        size_t falses = std::count(flags.begin(), flags.end(), false);
+        std::fill(flags.begin(), flags.begin() + falses, false);
+        std::fill(flags.begin() + falses, flags.end(), true);
+        return value_bd();
+    }
+    if (array.length() == 0) {
+        return value_bd();
+    }
+    std::vector<double> scratch;
+    const double* numbers = numbers_of(array, scratch);
+    std::shared_ptr<PackedArray> storage = std::make_shared<PackedArray>();
+    storage->flags_only = false;
+    storage->numbers.assign(numbers, numbers + array.length());
+    sort_numbers(storage->numbers);
+    array.adopt(storage);
+    return value_bd();
+}
+
+// find(a, v) is the position of the first element equal to v (by ==), or -1
+static value_bd builtin_find(value_bd** arguments){
+    const value_bd& array = array_argument(arguments[0]);
+    const value_bd& value = *arguments[1];
+    size_t count = array.length();
+    size_t found = count;
+    if (array.packed != nullptr && !array.packed->flags_only) {
+        if (value.type_tag == "double") {
+            found = find_number(array.packed->numbers.data() + array.offset, count, value.Double);
+        }
+    } else if (array.packed != nullptr) {
+        if (value.type_tag == "bool") {
+            auto first = array.packed->flags.begin() + array.offset;
+            found = std::find(first, first + count, value.Bool) - first;
+        }
+    } else {
+        for (size_t i = 0; i < count && found == count; i++) {
+            if (EqualOp::apply(array.array[i], value).Bool) {
+                found = i;
+            }
+        }
+    }
+    return value_bd("double", found == count ? -1.0 : (double)found);
+}
+
+// matrix(r, c) is an r x c matrix of zeros
+static value_bd builtin_matrix(value_bd** arguments){
+    double rows = number_argument(arguments[0]);
+    double columns = number_argument(arguments[1]);
+    if (rows < 1 || columns < 1 || rows != std::floor(rows) || columns != std::floor(columns)) {
+        throw EvaluationError("invalid matrix size.");
+    }
+    return make_matrix((size_t)rows, (size_t)columns);
+}
+
+static value_bd builtin_columns(value_bd** arguments){
+    return value_bd("double", (double)matrix_argument(arguments[0]).columns);
+}
+
+static value_bd builtin_transpose(value_bd** arguments){
+    const value_bd& matrix = matrix_argument(arguments[0]);
+    value_bd result = make_matrix(matrix.columns, matrix.rows());
+    transpose_blocked(matrix_numbers(matrix), result.packed->numbers.data(), matrix.rows(), matrix.columns);
+    return result;
+}
+
+static value_bd builtin_matmul(value_bd** arguments){
+    const value_bd& a = matrix_argument(arguments[0]);
+    const value_bd& b = matrix_argument(arguments[1]);
+    if (a.columns != b.rows()) {
+        throw EvaluationError("matrix sizes do not match.");
+    }
+    value_bd result = make_matrix(a.rows(), b.columns);
+    multiply_blocked(matrix_numbers(a), matrix_numbers(b), result.packed->numbers.data(), a.rows(), a.columns, b.columns);
+    return result;
+}
+
+// madd, msub and mmul: the sum, difference and element by element product of
+// two matrices of the same size
+template <class Op>
+static value_bd builtin_elementwise(value_bd** arguments){
+    const value_bd& a = matrix_argument(arguments[0]);
+    const value_bd& b = matrix_argument(arguments[1]);
+    if (a.rows() != b.rows() || a.columns != b.columns) {
+        throw EvaluationError("matrix sizes do not match.");
+    }
+    value_bd result = make_matrix(a.rows(), a.columns);
+    apply_batch<Op>(matrix_numbers(a), matrix_numbers(b), result.packed->numbers.data(), a.length());
+    return result;
+}
+
+static value_bd builtin_mscale(value_bd** arguments){
+    const value_bd& matrix = matrix_argument(arguments[0]);
+    double factor = number_argument(arguments[1]);
+    value_bd result = make_matrix(matrix.rows(), matrix.columns);
+    const double* in = matrix_numbers(matrix);
+    double* out = result.packed->numbers.data();
+    for (size_t i = 0; i < matrix.length(); i++) {
+        out[i] = in[i] * factor;
+    }
+    return result;
+}
+
+//----------------------
+
+static value_bd builtin_has(value_bd** arguments){
+    return value_bd("bool", dict_argument(arguments[0]).dict->find(*arguments[1]) != nullptr);
+}
+
+// whether the key was there
+static value_bd builtin_remove(value_bd** arguments){
+    value_bd& dict = dict_argument(arguments[0]);
+    if (dict.dict->find(*arguments[1]) == nullptr) {
+        return value_bd("bool", false);
+    }
+    return value_bd("bool", Dictionary::own(dict).remove(*arguments[1]));
+}
+
+static value_bd builtin_keys(value_bd** arguments){
+    value_bd result("array", dict_argument(arguments[0]).dict->keys());
+    result.pack();
+    return result;
+}
+
+//----------------------
+
+static value_bd builtin_heap(value_bd**){
+    value_bd result("heap", std::vector<value_bd>());
+    result.heap = std::make_shared<Heap>();
+    return result;
+}
+
+// heappush(h, k, v) adds v with the key k and returns the new size
+static value_bd builtin_heappush(value_bd** arguments){
+    double key = number_argument(arguments[1]);
+    Heap& heap = Heap::own(heap_argument(arguments[0]));
+    heap.push(key, *arguments[2]);
+    return value_bd("double", (double)heap.size());
+}
+
+// the value with the smallest key, removed by heappop; heapkey is that key
+static value_bd builtin_heappop(value_bd** arguments){
+    if (heap_argument(arguments[0]).heap->size() == 0) {
+        throw EvaluationError("empty heap.");
+    }
+    return Heap::own(*arguments[0]).pop();
+}
+
+static value_bd builtin_heaptop(value_bd** arguments){
+    const Heap& heap = *heap_argument(arguments[0]).heap;
+    if (heap.size() == 0) {
+        throw EvaluationError("empty heap.");
+    }
+    return heap.top();
+}
+
+static value_bd builtin_heapkey(value_bd** arguments){
+    const Heap& heap = *heap_argument(arguments[0]).heap;
+    if (heap.size() == 0) {
+        throw EvaluationError("empty heap.");
+    }
+    return value_bd("double", heap.top_key());
+}
+
+static value_bd builtin_deque(value_bd**){
+    value_bd result("deque", std::vector<value_bd>());
+    result.deque = std::make_shared<Deque>();
+    return result;
+}
+
+static value_bd builtin_pushfront(value_bd** arguments){
+    Deque& deque = Deque::own(deque_argument(arguments[0]));
+    deque.push_front(*arguments[1]);
+    return value_bd("double", (double)deque.size());
+}
+
+static value_bd builtin_popfront(value_bd** arguments){
+    if (deque_argument(arguments[0]).deque->size() == 0) {
+        throw EvaluationError("empty deque.");
+    }
+    return Deque::own(*arguments[0]).pop_front();
+}
+
+static value_bd builtin_front(value_bd** arguments){
+    const Deque& deque = *deque_argument(arguments[0]).deque;
+    if (deque.size() == 0) {
+        throw EvaluationError("empty deque.");
+    }
+    return deque.at(0);
+}
+
+static value_bd builtin_back(value_bd** arguments){
+    const Deque& deque = *deque_argument(arguments[0]).deque;
+    if (deque.size() == 0) {
+        throw EvaluationError("empty deque.");
+    }
+    return deque.at(deque.size() - 1);
+}
+
+//----------------------
+
+static const Builtin builtins[] = {
+    {"len", 1, false, builtin_len},
+    {"push", 2, true, builtin_push},
+    {"pop", 1, true, builtin_pop},
+    {"slice", 3, false, builtin_slice},
+    {"fill", 2, true, builtin_fill},
+    {"sum", 1, false, builtin_sum},
+    {"min", 1, false, builtin_min},
+    {"max", 1, false, builtin_max},
+    {"dot", 2, false, builtin_dot},
+    {"sort", 1, true, builtin_sort},
+    {"find", 2, false, builtin_find},
+    {"matrix", 2, false, builtin_matrix},
+    {"cols", 1, false, builtin_columns},
+    {"transpose", 1, false, builtin_transpose},
+    {"matmul", 2, false, builtin_matmul},
+    {"madd", 2, false, builtin_elementwise<AddOp>},
+    {"msub", 2, false, builtin_elementwise<SubtractOp>},
+    {"mmul", 2, false, builtin_elementwise<MultiplyOp>},
+    {"mscale", 2, false, builtin_mscale},
+    {"has", 2, false, builtin_has},
+    {"remove", 2, true, builtin_remove},
+    {"keys", 1, false, builtin_keys},
+    {"heap", 0, false, builtin_heap},
+    {"heappush", 3, true, builtin_heappush},
+    {"heappop", 1, true, builtin_heappop},
+    {"heaptop", 1, false, builtin_heaptop},
+    {"heapkey", 1, false, builtin_heapkey},
+    {"deque", 0, false, builtin_deque},
+    {"pushfront", 2, true, builtin_pushfront},
+    {"popfront", 1, true, builtin_popfront},
+    {"front", 1, false, builtin_front},
+    {"back", 1, false, builtin_back},
+};
+
+const Builtin* find_builtin(const std::string& name){
+    for (const Builtin& builtin : builtins) {
+        if (name == builtin.name) {
+            return &builtin;
+        }
+    }
+    return nullptr;
+}
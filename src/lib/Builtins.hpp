@@ -0,0 +1,25 @@
+#ifndef BUILTINS_HPP
+#define BUILTINS_HPP
+
+#include <string>
+
+#include "value_bd.hpp"
+
+// Functions implemented in C++ and called like any other, `n = len(a);`. A
+// call only reaches a builtin when its name is not a variable, so a function
+// the program defines under the same name hides it.
+//
+// Arguments that are plain variables are passed as pointers to their entries
+// in the map, so a builtin reads an array where it is stored instead of a copy.
+// A builtin that mutates changes its first argument there.
+struct Builtin {
+    const char* name;
+    size_t arity;
+    bool mutates;   //changes the value passed first: push, pop, fill, sort, remove and the heap and deque updates
+    value_bd (*run)(value_bd** arguments);
+};
+
+// nullptr when there is no builtin of that name
+const Builtin* find_builtin(const std::string& name);
+
+#endif
@@ -0,0 +1,175 @@
+#include "Collections.hpp"
+#include "ASTree.hpp"
+
+#include <algorithm>
+#include <utility>
+
+//----------------------
+
+// The new entry starts at the end and parents larger than its key move down
+// into the hole, so each level costs one key compare and one move
+void Heap::push(double key, const value_bd& value){
+    if (key != key) {
+        throw EvaluationError("invalid heap key.");
+    }
+    size_t hole = keys.size();
+    keys.push_back(key);
+    values.emplace_back();
+    while (hole > 0) {
+        size_t parent = (hole - 1) / 2;
+        if (keys[parent] <= key) {
+            break;
+        }
+        keys[hole] = keys[parent];
+        values[hole] = std::move(values[parent]);
+        hole = parent;
+    }
+    keys[hole] = key;
+    values[hole] = value;
+}
+
+// The last entry is taken out and the hole left at the top moves down to
+// where it fits, pulling the smaller child up at each level
+value_bd Heap::pop(){
+    value_bd result = std::move(values[0]);
+    double key = keys.back();
+    value_bd value = std::move(values.back());
+    keys.pop_back();
+    values.pop_back();
+    size_t count = keys.size();
+    if (count == 0) {
+        return result;
+    }
+    size_t hole = 0;
+    for (size_t child = 1; child < count; child = 2 * hole + 1) {
+        if (child + 1 < count && keys[child + 1] < keys[child]) {
+            child++;
+        }
+        if (key <= keys[child]) {
+            break;
+        }
+        keys[hole] = keys[child];
+        values[hole] = std::move(values[child]);
+        hole = child;
+    }
+    keys[hole] = key;
+    values[hole] = std::move(value);
+    return result;
+}
+
+std::vector<size_t> Heap::by_key() const{
+    std::vector<size_t> order(keys.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {return keys[a] < keys[b];});
+    return order;
+}
+
+// Heaps built from the same entries in another order keep them in other
+// places, so the entries are compared sorted by key. Values have no order,
+// so within a run of equal keys each value is matched with an equal one
+// of the other heap that is not taken yet.
+bool Heap::same_entries(const Heap& other) const{
+    if (keys.size() != other.keys.size()) {
+        return false;
+    }
+    std::vector<size_t> mine = by_key();
+    std::vector<size_t> theirs = other.by_key();
+    for (size_t i = 0; i < mine.size(); i++) {
+        if (keys[mine[i]] != other.keys[theirs[i]]) {
+            return false;
+        }
+    }
+    for (size_t first = 0; first < mine.size();) {
+        size_t end = first + 1;
+        while (end < mine.size() && keys[mine[end]] == keys[mine[first]]) {
+            end++;
+        }
+        std::vector<bool> taken(end - first, false);
+        for (size_t i = first; i < end; i++) {
+            size_t j = first;
+            while (j < end && (taken[j - first] || !equal_values(values[mine[i]], other.values[theirs[j]]))) {
+                j++;
+            }
+            if (j == end) {
+                return false;
+            }
+            taken[j - first] = true;
+        }
+        first = end;
+    }
+    return true;
+}
+
+Heap& Heap::own(value_bd& value){
+    if (value.heap.use_count() > 1) {
+        value.heap = std::make_shared<Heap>(*value.heap);
+    }
+    return *value.heap;
+}
+
+//----------------------
+
+// Doubles the ring, moving the elements to the start of the new one
+void Deque::grow(){
+    std::vector<value_bd> larger(ring.empty() ? 8 : ring.size() * 2);
+    for (size_t i = 0; i < count; i++) {
+        larger[i] = std::move(ring[(head + i) & (ring.size() - 1)]);
+    }
+    ring.swap(larger);
+    head = 0;
+}
+
+void Deque::push_front(const value_bd& value){
+    if (count == ring.size()) {
+        grow();
+    }
+    head = (head - 1) & (ring.size() - 1);
+    ring[head] = value;
+    count++;
+}
+
+void Deque::push_back(const value_bd& value){
+    if (count == ring.size()) {
+        grow();
+    }
+    ring[(head + count) & (ring.size() - 1)] = value;
+    count++;
+}
+
+// The slot given up is reset so it does not keep a share of an array
+value_bd Deque::pop_front(){
+    value_bd result = std::move(ring[head]);
+    ring[head] = value_bd();
+    head = (head + 1) & (ring.size() - 1);
+    count--;
+    return result;
+}
+
+value_bd Deque::pop_back(){
+    value_bd& last = ring[(head + count - 1) & (ring.size() - 1)];
+    value_bd result = std::move(last);
+    last = value_bd();
+    count--;
+    return result;
+}
+
+bool Deque::same_entries(const Deque& other) const{
+    if (count != other.count) {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (!equal_values(at(i), other.at(i))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+Deque& Deque::own(value_bd& value){
+    if (value.deque.use_count() > 1) {
+        value.deque = std::make_shared<Deque>(*value.deque);
+    }
+    return *value.deque;
+}
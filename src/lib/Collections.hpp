@@ -0,0 +1,55 @@
+#ifndef COLLECTIONS_HPP
+#define COLLECTIONS_HPP
+
+#include <vector>
+
+#include "value_bd.hpp"
+
+// The entries of a heap value, a priority queue of values ordered by number
+// keys, smallest first. A binary heap kept in two parallel vectors, so the
+// sifts compare keys packed next to each other and only move the values.
+// Copies of the heap value share it until one of them writes.
+class Heap {
+public:
+    size_t size() const {return keys.size();}
+    void push(double key, const value_bd& value);
+    value_bd pop();                                     //the value with the smallest key
+    double top_key() const {return keys[0];}
+    const value_bd& top() const {return values[0];}
+    bool same_entries(const Heap& other) const;         //the same (key, value) pairs, in any order
+
+    // The heap held by value, copied first when other values share it
+    static Heap& own(value_bd& value);
+
+private:
+    std::vector<double> keys;       //keys[i] is at most the keys of 2i+1 and 2i+2
+    std::vector<value_bd> values;   //values[i] goes with keys[i]
+
+    std::vector<size_t> by_key() const;     //positions of the entries, smallest key first
+};
+
+// The elements of a deque value, added and removed at either end in constant
+// time. A ring buffer whose capacity is a power of two: the elements are
+// ring[head], ring[head+1], ... wrapping around, and it doubles when full.
+// Copies of the deque value share it until one of them writes.
+class Deque {
+public:
+    size_t size() const {return count;}
+    const value_bd& at(size_t i) const {return ring[(head + i) & (ring.size() - 1)];}
+    void push_front(const value_bd& value);
+    void push_back(const value_bd& value);
+    value_bd pop_front();
+    value_bd pop_back();
+    bool same_entries(const Deque& other) const;
+
+    static Deque& own(value_bd& value);
+
+private:
+    std::vector<value_bd> ring;
+    size_t head = 0;
+    size_t count = 0;
+
+    void grow();
+};
+
+#endif
@@ -0,0 +1,223 @@
+#include "Dictionary.hpp"
+#include "ASTree.hpp"
+
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+//----------------------
+
+// Control bytes: a full slot holds 7 bits of its hash, which are never
+// negative, so the high bit alone tells a free slot
+static const int8_t empty_slot = -128;
+static const int8_t deleted_slot = -2;
+static const size_t group_size = 16;
+static const size_t none = (size_t)-1;
+
+// Bit i set when byte i of the group equals byte
+static uint32_t matching(const int8_t* group, int8_t byte){
+#ifdef __SSE2__
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(byte)));
+#else
+    uint32_t found = 0;
+    for (size_t i = 0; i < group_size; i++) {
+        found |= (uint32_t)(group[i] == byte) << i;
+    }
+    return found;
+#endif
+}
+
+// Bit i set when slot i of the group is empty or deleted
+static uint32_t free_slots(const int8_t* group){
+#ifdef __SSE2__
+    return _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(group)));
+#else
+    uint32_t found = 0;
+    for (size_t i = 0; i < group_size; i++) {
+        found |= (uint32_t)(group[i] < 0) << i;
+    }
+    return found;
+#endif
+}
+
+static void key_bits(const value_bd& key, uint64_t& bits, bool& flag){
+    if (key.type_tag == "bool") {
+        bits = key.Bool;
+        flag = true;
+        return;
+    }
+    if (key.type_tag != "double" || key.Double != key.Double) {
+        throw EvaluationError("invalid dictionary key.");
+    }
+    double number = key.Double == 0 ? 0.0 : key.Double;    //-0 is the key 0
+    std::memcpy(&bits, &number, sizeof(bits));
+    flag = false;
+}
+
+uint64_t Dictionary::hash(uint64_t bits, bool flag){
+    uint64_t hashed = bits ^ (flag ? 0x9e3779b97f4a7c15ULL : 0);
+    hashed = (hashed ^ (hashed >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    hashed = (hashed ^ (hashed >> 27)) * 0x94d049bb133111ebULL;
+    return hashed ^ (hashed >> 31);
+}
+
+//----------------------
+
+// The groups are probed at steps 1, 2, 3, ... from the one the hash picks,
+// which visits every group of a power of two. The table is never more than
+// 7/8 full, counting deleted slots, so some group always has an empty slot
+// and a key that is absent stops there.
+size_t Dictionary::search(uint64_t bits, bool flag, uint64_t hashed) const{
+    if (control.empty()) {
+        return none;
+    }
+    size_t mask = control.size() / group_size - 1;
+    size_t group = (hashed >> 7) & mask;
+    int8_t tag = hashed & 0x7f;
+    for (size_t step = 1; ; step++) {
+        const int8_t* bytes = &control[group * group_size];
+        for (uint32_t found = matching(bytes, tag); found != 0; found &= found - 1) {
+            size_t at = group * group_size + __builtin_ctz(found);
+            if (slots[at].bits == bits && slots[at].flag == flag) {
+                return at;
+            }
+        }
+        if (matching(bytes, empty_slot) != 0) {
+            return none;
+        }
+        group = (group + step) & mask;
+    }
+}
+
+const value_bd* Dictionary::find(const value_bd& key) const{
+    uint64_t bits;
+    bool flag;
+    key_bits(key, bits, flag);
+    size_t at = search(bits, flag, hash(bits, flag));
+    return at == none ? nullptr : &slots[at].value;
+}
+
+value_bd& Dictionary::entry(const value_bd& key){
+    uint64_t bits;
+    bool flag;
+    key_bits(key, bits, flag);
+    uint64_t hashed = hash(bits, flag);
+    size_t at = search(bits, flag, hashed);
+    if (at != none) {
+        return slots[at].value;
+    }
+    if ((count + deleted + 1) * 8 > control.size() * 7) {
+        //grows when live keys fill it past half; otherwise only clears deleted slots
+        size_t capacity = control.empty() ? group_size : control.size();
+        if ((count + 1) * 2 > capacity) {
+            capacity *= 2;
+        }
+        rehash(capacity);
+    }
+    return slots[place(bits, flag, hashed)].value;
+}
+
+// The first free slot on the key's probe sequence, for a key known absent
+size_t Dictionary::place(uint64_t bits, bool flag, uint64_t hashed){
+    size_t mask = control.size() / group_size - 1;
+    size_t group = (hashed >> 7) & mask;
+    size_t at = 0;
+    for (size_t step = 1; ; step++) {
+        uint32_t found = free_slots(&control[group * group_size]);
+        if (found != 0) {
+            at = group * group_size + __builtin_ctz(found);
+            break;
+        }
+        group = (group + step) & mask;
+    }
+    if (control[at] == deleted_slot) {
+        deleted--;
+    }
+    control[at] = hashed & 0x7f;
+    slots[at].bits = bits;
+    slots[at].flag = flag;
+    count++;
+    return at;
+}
+
+// A slot in a group that still has an empty slot can be emptied: no probe
+// ever went past that group, so no other key depends on it
+bool Dictionary::remove(const value_bd& key){
+    uint64_t bits;
+    bool flag;
+    key_bits(key, bits, flag);
+    size_t at = search(bits, flag, hash(bits, flag));
+    if (at == none) {
+        return false;
+    }
+    if (matching(&control[at / group_size * group_size], empty_slot) != 0) {
+        control[at] = empty_slot;
+    } else {
+        control[at] = deleted_slot;
+        deleted++;
+    }
+    slots[at].value = value_bd();
+    count--;
+    return true;
+}
+
+void Dictionary::rehash(size_t capacity){
+    std::vector<int8_t> old_control(capacity, empty_slot);
+    std::vector<Slot> old_slots(capacity);
+    old_control.swap(control);
+    old_slots.swap(slots);
+    count = 0;
+    deleted = 0;
+    for (size_t i = 0; i < old_control.size(); i++) {
+        if (old_control[i] >= 0) {
+            Slot& moved = old_slots[i];
+            slots[place(moved.bits, moved.flag, hash(moved.bits, moved.flag))].value = std::move(moved.value);
+        }
+    }
+}
+
+//----------------------
+
+std::vector<value_bd> Dictionary::keys() const{
+    std::vector<value_bd> result;
+    result.reserve(count);
+    for (size_t i = 0; i < control.size(); i++) {
+        if (control[i] < 0) {
+            continue;
+        }
+        if (slots[i].flag) {
+            result.push_back(value_bd("bool", (double)slots[i].bits));
+        } else {
+            double number;
+            std::memcpy(&number, &slots[i].bits, sizeof(number));
+            result.push_back(value_bd("double", number));
+        }
+    }
+    return result;
+}
+
+bool Dictionary::same_entries(const Dictionary& other) const{
+    if (count != other.count) {
+        return false;
+    }
+    for (size_t i = 0; i < control.size(); i++) {
+        if (control[i] < 0) {
+            continue;
+        }
+        size_t at = other.search(slots[i].bits, slots[i].flag, hash(slots[i].bits, slots[i].flag));
+        if (at == none || !equal_values(slots[i].value, other.slots[at].value)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+Dictionary& Dictionary::own(value_bd& value){
+    if (value.dict.use_count() > 1) {
+        value.dict = std::make_shared<Dictionary>(*value.dict);
+    }
+    return *value.dict;
+}
@@ -0,0 +1,46 @@
+#ifndef DICTIONARY_HPP
+#define DICTIONARY_HPP
+
+#include <vector>
+#include <cstdint>
+
+#include "value_bd.hpp"
+
+// The entries of a dictionary value, {k: v}. Keys are numbers or bools and
+// two keys are the same when == says so, so 0 and -0 are one key; NaN is not
+// a key. Copies of the dictionary value share it until one of them writes.
+//
+// Open addressing in the style of a swiss table: each slot has a control
+// byte, either empty, deleted or the low 7 bits of its key's hash, and the
+// bytes are probed sixteen at a time (one SSE2 compare when built with
+// __SSE2__), so a lookup only reads the slots whose bits match.
+class Dictionary {
+public:
+    size_t size() const {return count;}
+    const value_bd* find(const value_bd& key) const;
+    value_bd& entry(const value_bd& key);      //added as null when absent
+    bool remove(const value_bd& key);
+    std::vector<value_bd> keys() const;         //in table order, not the order added
+    bool same_entries(const Dictionary& other) const;
+
+    // The dictionary held by value, copied first when other values share it
+    static Dictionary& own(value_bd& value);
+
+private:
+    struct Slot {
+        uint64_t bits;      //of the number, or 0 and 1 for a bool
+        bool flag;          //a bool key
+        value_bd value;
+    };
+    std::vector<int8_t> control;                //a multiple of sixteen bytes
+    std::vector<Slot> slots;
+    size_t count = 0;
+    size_t deleted = 0;
+
+    static uint64_t hash(uint64_t bits, bool flag);
+    size_t search(uint64_t bits, bool flag, uint64_t hashed) const;
+    size_t place(uint64_t bits, bool flag, uint64_t hashed);
+    void rehash(size_t capacity);
+};
+
+#endif
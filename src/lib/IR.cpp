@@ -0,0 +1,975 @@
+#include "IR.hpp"
+#include <sstream>
+#include <algorithm>
+
+//----------------------
+
+static bool binary_op(ASTNode* node, IROp& op){
+    if (dynamic_cast<AdditionNode*>(node))          op = IROp::Add;
+    else if (dynamic_cast<SubtractionNode*>(node))  op = IROp::Subtract;
+    else if (dynamic_cast<MultiplicationNode*>(node)) op = IROp::Multiply;
+    else if (dynamic_cast<DivisionNode*>(node))     op = IROp::Divide;
+    else if (dynamic_cast<ModuloNode*>(node))       op = IROp::Modulo;
+    else if (dynamic_cast<LessNode*>(node))         op = IROp::Less;
+    else if (dynamic_cast<LessEqualNode*>(node))    op = IROp::LessEqual;
+    else if (dynamic_cast<MoreNode*>(node))         op = IROp::More;
+    else if (dynamic_cast<MoreEqualNode*>(node))    op = IROp::MoreEqual;
+    else if (dynamic_cast<EqualNode*>(node))        op = IROp::Equal;
+    else if (dynamic_cast<NotEqualNode*>(node))     op = IROp::NotEqual;
+    else if (dynamic_cast<LandNode*>(node))         op = IROp::And;
+    else if (dynamic_cast<LxorNode*>(node))         op = IROp::Xor;
+    else if (dynamic_cast<LorNode*>(node))          op = IROp::Or;
+    else return false;
+    return true;
+}
+
+static ASTNode* operator_node(IROp op, ASTNode* left, ASTNode* right){
+    switch (op) {
+        case IROp::Add:         return new AdditionNode(0, 0, left, right);
+        case IROp::Subtract:    return new SubtractionNode(0, 0, left, right);
+        case IROp::Multiply:    return new MultiplicationNode(0, 0, left, right);
+        case IROp::Divide:      return new DivisionNode(0, 0, left, right);
+        case IROp::Modulo:      return new ModuloNode(0, 0, left, right);
+        case IROp::Less:        return new LessNode(0, 0, left, right);
+        case IROp::LessEqual:   return new LessEqualNode(0, 0, left, right);
+        case IROp::More:        return new MoreNode(0, 0, left, right);
+        case IROp::MoreEqual:   return new MoreEqualNode(0, 0, left, right);
+        case IROp::Equal:       return new EqualNode(0, 0, left, right);
+        case IROp::NotEqual:    return new NotEqualNode(0, 0, left, right);
+        case IROp::And:         return new LandNode(0, 0, left, right);
+        case IROp::Xor:         return new LxorNode(0, 0, left, right);
+        case IROp::Or:          return new LorNode(0, 0, left, right);
+        default:                return nullptr;
+    }
+}
+
+static IRType result_type(IROp op){
+    switch (op) {
+        case IROp::Add: case IROp::Subtract: case IROp::Multiply: case IROp::Divide: case IROp::Modulo:
+            return IRType::Double;
+        case IROp::Less: case IROp::LessEqual: case IROp::More: case IROp::MoreEqual:
+        case IROp::Equal: case IROp::NotEqual: case IROp::And: case IROp::Xor: case IROp::Or:
+            return IRType::Bool;
+        case IROp::Slice:
+            return IRType::Array;
+        case IROp::Dict:
+            return IRType::Dict;
+        case IROp::Record:
+            return IRType::Record;
+        case IROp::Define:
+            return IRType::Function;
+        case IROp::Print:
+            return IRType::Null;
+        default:
+            return IRType::Unknown;
+    }
+}
+
+static IRType value_type(const value_bd& value){
+    if (value.type_tag == "double") return IRType::Double;
+    if (value.type_tag == "bool")   return IRType::Bool;
+    if (value.type_tag == "array")  return IRType::Array;
+    if (value.type_tag == "dict")   return IRType::Dict;
+    if (value.type_tag == "record") return IRType::Record;
+    if (value.type_tag == "function") return IRType::Function;
+    return IRType::Null;
+}
+
+static ASTNode* literal_node(const value_bd& value, const std::string& text){
+    if (value.type_tag == "double") {
+        return new NumberNode(0, 0, value.Double, text);
+    } else if (value.type_tag == "bool") {
+        return new BooleanNode(0, 0, value.Bool, text);
+    }
+    return nullptr;
+}
+
+static bool same_constant(const value_bd& a, const value_bd& b){
+    if (a.type_tag != b.type_tag) {
+        return false;
+    }
+    if (a.type_tag == "double") {
+        return a.Double == b.Double;
+    } else if (a.type_tag == "bool") {
+        return a.Bool == b.Bool;
+    }
+    return false;
+}
+
+// Evaluates an operator on known operands with the tree's own rules, so the
+// IR can never disagree with the interpreter. Failing operations stay unknown.
+static bool fold_operation(IROp op, const value_bd& left, const value_bd& right, value_bd& result){
+    ASTNode* l = literal_node(left, "");
+    ASTNode* r = literal_node(right, "");
+    if (l == nullptr || r == nullptr) {
+        delete l;
+        delete r;
+        return false;
+    }
+    ASTNode* node = operator_node(op, l, r);
+    bool folded = true;
+    try {
+        result = node->evaluate(nullptr);
+    } catch (const EvaluationError& e) {
+        folded = false;
+    }
+    delete node;
+    return folded;
+}
+
+static const char* op_name(IROp op){
+    switch (op) {
+        case IROp::Constant:    return "const";
+        case IROp::Entry:       return "entry";
+        case IROp::Parameter:   return "param";
+        case IROp::Phi:         return "phi";
+        case IROp::Opaque:      return "opaque";
+        case IROp::Add:         return "add";
+        case IROp::Subtract:    return "sub";
+        case IROp::Multiply:    return "mul";
+        case IROp::Divide:      return "div";
+        case IROp::Modulo:      return "mod";
+        case IROp::Less:        return "lt";
+        case IROp::LessEqual:   return "le";
+        case IROp::More:        return "gt";
+        case IROp::MoreEqual:   return "ge";
+        case IROp::Equal:       return "eq";
+        case IROp::NotEqual:    return "ne";
+        case IROp::And:         return "and";
+        case IROp::Xor:         return "xor";
+        case IROp::Or:          return "or";
+        case IROp::Index:       return "index";
+        case IROp::SetIndex:    return "setindex";
+        case IROp::Slice:       return "slice";
+        case IROp::Dict:        return "dict";
+        case IROp::Record:      return "record";
+        case IROp::Field:       return "field";
+        case IROp::Range:       return "range";
+        case IROp::Next:        return "next";
+        case IROp::Define:      return "def";
+        case IROp::Call:        return "call";
+        case IROp::Print:       return "print";
+        case IROp::Select:      return "select";
+    }
+    return "";
+}
+
+static const char* type_name(IRType type){
+    switch (type) {
+        case IRType::Unknown:   return "any";
+        case IRType::Null:      return "null";
+        case IRType::Double:    return "double";
+        case IRType::Bool:      return "bool";
+        case IRType::Array:     return "array";
+        case IRType::Dict:      return "dict";
+        case IRType::Record:    return "record";
+        case IRType::Function:  return "function";
+    }
+    return "";
+}
+
+static std::string constant_text(const value_bd& value){
+    std::ostringstream os;
+    if (value.type_tag == "double") {
+        os << value.Double;
+    } else if (value.type_tag == "bool") {
+        os << (value.Bool ? "true" : "false");
+    } else if (value.type_tag == "array") {
+        os << "array(" << value.length() << ")";
+    } else {
+        os << "null";
+    }
+    return os.str();
+}
+
+//----------------------
+
+IRFunction::~IRFunction(){
+    for (IRBlock* block : blocks) {
+        delete block;
+    }
+    for (IRValue* value : values) {
+        delete value;
+    }
+}
+
+IRBlock* IRFunction::new_block(){
+    IRBlock* block = new IRBlock();
+    block->id = blocks.size();
+    blocks.push_back(block);
+    return block;
+}
+
+IRValue* IRFunction::new_value(IROp op, IRBlock* block){
+    IRValue* value = new IRValue();
+    value->id = values.size();
+    value->op = op;
+    value->type = result_type(op);
+    value->block = block;
+    values.push_back(value);
+    if (op == IROp::Phi) {
+        block->phis.push_back(value);
+    } else {
+        block->instructions.push_back(value);
+    }
+    return value;
+}
+
+void IRFunction::dump(std::ostream& out){
+    out << "function " << name << "(";
+    for (size_t i = 0; i < parameters.size(); ++i) {
+        out << (i == 0 ? "" : ", ") << parameters[i];
+    }
+    out << ") {\n";
+    for (IRBlock* block : blocks) {
+        out << "b" << block->id << ":";
+        if (!block->predecessors.empty()) {
+            out << "    ; preds";
+            for (IRBlock* pred : block->predecessors) {
+                out << " b" << pred->id;
+            }
+        }
+        out << "\n";
+        std::vector<IRValue*> all(block->phis);
+        all.insert(all.end(), block->instructions.begin(), block->instructions.end());
+        for (IRValue* value : all) {
+            std::ostringstream line;
+            if (value->op != IROp::Print) {
+                line << "%" << value->id << " = ";
+            }
+            line << op_name(value->op);
+            if (value->op == IROp::Constant) {
+                line << " " << constant_text(value->constant);
+            } else if (value->op == IROp::Entry || value->op == IROp::Parameter || value->op == IROp::Opaque) {
+                line << " " << value->variable;
+            } else if (value->op == IROp::Define) {
+                line << " " << value->function->name;
+            }
+            for (size_t i = 0; i < value->operands.size(); ++i) {
+                line << (i == 0 ? " " : ", ") << "%" << IRProgram::resolve(value->operands[i])->id;
+                if (value->op == IROp::Phi) {
+                    line << " b" << block->predecessors[i]->id;
+                }
+            }
+            if (value->op != IROp::Print) {
+                line << " : " << type_name(value->type);
+            }
+            if (value->known && value->op != IROp::Constant) {
+                line << " = " << constant_text(value->constant);
+            }
+            if (!value->variable.empty() && value->op != IROp::Entry && value->op != IROp::Parameter && value->op != IROp::Opaque) {
+                line << "    ; " << value->variable;
+            }
+            out << "    " << line.str() << "\n";
+        }
+        if (block->returns) {
+            out << "    return";
+            if (block->returned != nullptr) {
+                out << " %" << IRProgram::resolve(block->returned)->id;
+            }
+            out << "\n";
+        } else if (block->successors.size() == 2) {
+            out << "    branch %" << IRProgram::resolve(block->condition)->id << ", b" << block->successors[0]->id << ", b" << block->successors[1]->id << "\n";
+        } else if (block->successors.size() == 1) {
+            out << "    jump b" << block->successors[0]->id << "\n";
+        }
+    }
+    out << "}\n";
+}
+
+//----------------------
+
+IRProgram::IRProgram(STree* tree){
+    lower_function("main", {}, tree);
+}
+
+IRProgram::~IRProgram(){
+    for (IRFunction* function : functions) {
+        delete function;
+    }
+}
+
+void IRProgram::dump(std::ostream& out){
+    for (IRFunction* function : functions) {
+        function->dump(out);
+    }
+}
+
+IRValue* IRProgram::resolve(IRValue* value){
+    while (value != nullptr && value->replacement != nullptr) {
+        value = value->replacement;
+    }
+    return value;
+}
+
+void IRProgram::jump(IRBlock* from, IRBlock* to){
+    from->successors.push_back(to);
+    to->predecessors.push_back(from);
+}
+
+//----------------------
+
+// Whatever a function body finds in its map when it starts, from the scope it
+// was defined in or from an earlier call, is an entry value.
+IRFunction* IRProgram::lower_function(const std::string& name, const std::vector<std::string>& parameters, STree* code){
+    IRFunction* function = new IRFunction();
+    function->name = name;
+    function->parameters = parameters;
+    functions.push_back(function);
+
+    IRBlock* entry = function->new_block();
+    entry->sealed = true;
+    for (const std::string& parameter : parameters) {
+        IRValue* value = function->new_value(IROp::Parameter, entry);
+        value->variable = parameter;
+        write_variable(entry, parameter, value);
+    }
+    IRBlock* current = entry;
+    lower_block(function, code, current, true);
+    if (current != nullptr) {
+        current->returns = true;
+    }
+    remove_trivial_phis(function);
+    infer_phi_types(function);
+    return function;
+}
+
+// A return ends the statement chain it is in. Only at the level of the function
+// body does that return from the function; inside an if or while block the
+// interpreter just carries on after the block, and so does the IR.
+void IRProgram::lower_block(IRFunction* function, STree* tree, IRBlock*& current, bool function_level){
+    if (tree == nullptr) {
+        return;
+    }
+    for (SNode* node = tree->head; node != nullptr && current != nullptr; node = node->next) {
+        if (ForNode* each = dynamic_cast<ForNode*>(node)) {
+            //the range or array is evaluated once; whether there is another
+            //element is not known here, and the variable gets a new value
+            //at the start of every iteration
+            IRValue* source = lower_expression(function, current, &each->expression->expression->head, nullptr);
+            IRBlock* header = function->new_block();
+            jump(current, header);
+            IRValue* more = function->new_value(IROp::Opaque, header);
+            more->variable = each->expression->expression->print_no_endl();
+            IRBlock* body = function->new_block();
+            IRBlock* exit = function->new_block();
+            header->condition = more;
+            jump(header, body);
+            jump(header, exit);
+            seal(function, body);
+            IRValue* element = function->new_value(IROp::Next, body);
+            element->operands.push_back(source);
+            element->variable = each->variable;
+            if (source->op == IROp::Range) {
+                element->type = IRType::Double;
+            }
+            write_variable(body, each->variable, element);
+            IRBlock* end = body;
+            lower_block(function, each->trueBranch, end, false);
+            jump(end, header);
+            seal(function, header);
+            seal(function, exit);
+            current = exit;
+        } else if (WhileNode* loop = dynamic_cast<WhileNode*>(node)) {
+            IRBlock* header = function->new_block();
+            jump(current, header);
+            IRValue* condition = lower_expression(function, header, &loop->expression->expression->head, nullptr);
+            IRBlock* body = function->new_block();
+            IRBlock* exit = function->new_block();
+            header->condition = condition;
+            jump(header, body);
+            jump(header, exit);
+            seal(function, body);
+            IRBlock* end = body;
+            lower_block(function, loop->trueBranch, end, false);
+            jump(end, header);
+            seal(function, header);
+            seal(function, exit);
+            current = exit;
+        } else if (IfNode* branch = dynamic_cast<IfNode*>(node)) {
+            IRValue* condition = lower_expression(function, current, &branch->expression->expression->head, nullptr);
+            IRBlock* then_block = function->new_block();
+            IRBlock* else_block = function->new_block();
+            current->condition = condition;
+            jump(current, then_block);
+            jump(current, else_block);
+            seal(function, then_block);
+            seal(function, else_block);
+            IRBlock* join = function->new_block();
+            IRBlock* end = then_block;
+            lower_block(function, branch->trueBranch, end, false);
+            jump(end, join);
+            end = else_block;
+            lower_block(function, branch->falseBranch, end, false);
+            jump(end, join);
+            seal(function, join);
+            current = join;
+        } else if (FuncNode* func = dynamic_cast<FuncNode*>(node)) {
+            IRValue* value = function->new_value(IROp::Define, current);
+            value->function = lower_function(func->f_name, func->parameters, func->code);
+            value->variable = func->f_name;
+            write_variable(current, func->f_name, value);
+        } else if (dynamic_cast<ReturnNode*>(node) != nullptr) {
+            IRValue* value = nullptr;
+            if (node->expression != nullptr && node->expression->expression->print_no_endl() != "null") {
+                value = lower_expression(function, current, &node->expression->expression->head, nullptr);
+            }
+            if (function_level) {
+                current->returns = true;
+                current->returned = value;
+                current = nullptr;
+            }
+            return;
+        } else if (dynamic_cast<PrintNode*>(node) != nullptr) {
+            IRValue* value = nullptr;
+            if (node->expression->kind == ExpKind::Expression) {
+                value = lower_expression(function, current, &node->expression->expression->head, nullptr);
+            } else {
+                value = lower_call(function, current, node->expression->function);
+            }
+            IRValue* print = function->new_value(IROp::Print, current);
+            print->operands.push_back(value);
+        } else if (node->expression != nullptr) {
+            if (node->expression->kind == ExpKind::Expression) {
+                lower_expression(function, current, &node->expression->expression->head, nullptr);
+            } else if (node->expression->kind == ExpKind::Function) {
+                lower_call(function, current, node->expression->function);
+            } else if (node->expression->kind == ExpKind::FunctionAssigner) {
+                IRValue* value = lower_call(function, current, node->expression->function);
+                ASTNode* head = node->expression->expression->head;
+                if (dynamic_cast<IdentifierNode*>(head) != nullptr) {
+                    write_variable(current, node->expression->target, value);
+                } else if (!node->expression->target.empty()) {
+                    lower_store(function, current, static_cast<IndexNode*>(head), value);
+                } else {
+                    IRValue* invalid = function->new_value(IROp::Opaque, current);
+                    invalid->variable = head->print();
+                }
+            }
+        }
+    }
+}
+
+IRValue* IRProgram::lower_call(IRFunction* function, IRBlock* current, function_call* call){
+    IRValue* callee = read_variable(function, current, call->name);
+    std::vector<IRValue*> arguments;
+    for (ASTree* argument : call->arguments) {
+        arguments.push_back(lower_expression(function, current, &argument->head, nullptr));
+    }
+    IRValue* value = function->new_value(IROp::Call, current);
+    value->variable = call->name;
+    value->operands.push_back(callee);
+    value->operands.insert(value->operands.end(), arguments.begin(), arguments.end());
+    std::string mutated = call->mutated();
+    if (!mutated.empty()) {
+        IRValue* changed = function->new_value(IROp::Opaque, current);
+        changed->variable = mutated;
+        write_variable(current, mutated, changed);
+    }
+    return value;
+}
+
+// A write of value into an element or field of the variable the target is rooted at
+void IRProgram::lower_store(IRFunction* function, IRBlock* current, IndexNode* target, IRValue* value){
+    //every index down to the variable, outermost first like the interpreter;
+    //a field has none, its slot is fixed
+    IRValue* at = nullptr;
+    for (IndexNode* level = target; level != nullptr; level = dynamic_cast<IndexNode*>(level->base)) {
+        if (level->index != nullptr) {
+            IRValue* position = lower_expression(function, current, &level->index, level);
+            at = at ? at : position;
+        }
+    }
+    IRValue* set = function->new_value(IROp::SetIndex, current);
+    set->operands.push_back(read_variable(function, current, target->name));
+    set->operands.push_back(value);
+    if (at != nullptr) {
+        set->operands.push_back(at);
+    }
+    set->variable = target->name;
+    write_variable(current, target->name, set);
+}
+
+IRValue* IRProgram::lower_expression(IRFunction* function, IRBlock* current, ASTNode** site, ASTNode* owner){
+    ASTNode* node = *site;
+    IRValue* value = nullptr;
+    IROp op;
+    if (NumberNode* number = dynamic_cast<NumberNode*>(node)) {
+        value = function->new_value(IROp::Constant, current);
+        value->constant = number->value;
+    } else if (BooleanNode* boolean = dynamic_cast<BooleanNode*>(node)) {
+        value = function->new_value(IROp::Constant, current);
+        value->constant = boolean->value;
+    } else if (IdentifierNode* id = dynamic_cast<IdentifierNode*>(node)) {
+        if (id->name == "null") {
+            value = function->new_value(IROp::Constant, current);
+            value->constant = value_bd("null", "null");
+        } else {
+            value = read_variable(function, current, id->name);
+            uses.push_back({site, owner, value});
+        }
+        return value;
+    } else if (AssignmentNode* assignment = dynamic_cast<AssignmentNode*>(node)) {
+        value = lower_expression(function, current, &assignment->value, assignment);
+        if (IdentifierNode* target = dynamic_cast<IdentifierNode*>(assignment->id)) {
+            write_variable(current, target->name, value);
+        } else if (dynamic_cast<IndexNode*>(assignment->id) != nullptr && !static_cast<IndexNode*>(assignment->id)->name.empty()) {
+            lower_store(function, current, static_cast<IndexNode*>(assignment->id), value);
+        } else {
+            IRValue* invalid = function->new_value(IROp::Opaque, current);
+            invalid->variable = node->print();
+        }
+        uses.push_back({site, owner, value});
+        return value;
+    } else if (TempStoreNode* store = dynamic_cast<TempStoreNode*>(node)) {
+        value = lower_expression(function, current, &store->expression, store);
+        write_variable(current, store->name, value);
+        uses.push_back({site, owner, value});
+        return value;
+    } else if (TempLoadNode* load = dynamic_cast<TempLoadNode*>(node)) {
+        value = read_variable(function, current, load->name);
+        uses.push_back({site, owner, value});
+        return value;
+    } else if (binary_op(node, op)) {
+        OperatorNode* binary = static_cast<OperatorNode*>(node);
+        IRValue* left = lower_expression(function, current, &binary->left, binary);
+        IRValue* right = nullptr;
+        if (binary->short_circuit()) {
+            std::set<std::string> written;
+            right = lower_conditional(function, current, &binary->right, binary, written);
+            forget(function, current, written);
+        } else {
+            right = lower_expression(function, current, &binary->right, binary);
+        }
+        value = function->new_value(op, current);
+        value->operands = {left, right};
+        uses.push_back({site, owner, value});
+        return value;
+    } else if (ConditionalNode* conditional = dynamic_cast<ConditionalNode*>(node)) {
+        IRValue* condition = lower_expression(function, current, &conditional->condition, conditional);
+        std::set<std::string> written;
+        IRValue* taken = lower_conditional(function, current, &conditional->taken, conditional, written);
+        IRValue* other = lower_conditional(function, current, &conditional->other, conditional, written);
+        forget(function, current, written);
+        value = function->new_value(IROp::Select, current);
+        value->operands = {condition, taken, other};
+        uses.push_back({site, owner, value});
+        return value;
+    } else if (ArrayNode* array = dynamic_cast<ArrayNode*>(node)) {
+        value = function->new_value(IROp::Constant, current);
+        value->constant = array->value;
+    } else if (FieldNode* field = dynamic_cast<FieldNode*>(node)) {
+        IRValue* base = nullptr;
+        if (field->by_name) {
+            base = read_variable(function, current, field->name);
+        } else {
+            base = lower_expression(function, current, &field->base, field);
+        }
+        value = function->new_value(IROp::Field, current);
+        value->operands = {base};
+        value->variable = field->field;
+        uses.push_back({site, owner, value});
+        return value;
+    } else if (IndexNode* element = dynamic_cast<IndexNode*>(node)) {
+        IRValue* at = lower_expression(function, current, &element->index, element);
+        IRValue* base = nullptr;
+        if (element->by_name) {
+            base = read_variable(function, current, element->name);
+        } else {
+            base = lower_expression(function, current, &element->base, element);
+        }
+        value = function->new_value(IROp::Index, current);
+        value->operands = {base, at};
+        uses.push_back({site, owner, value});
+        return value;
+    } else if (SliceNode* slice = dynamic_cast<SliceNode*>(node)) {
+        //the bounds are evaluated before the base
+        std::vector<IRValue*> bounds;
+        if (slice->from != nullptr) {
+            bounds.push_back(lower_expression(function, current, &slice->from, slice));
+        }
+        if (slice->to != nullptr) {
+            bounds.push_back(lower_expression(function, current, &slice->to, slice));
+        }
+        IRValue* base = nullptr;
+        if (!slice->name.empty()) {
+            base = read_variable(function, current, slice->name);
+        } else {
+            base = lower_expression(function, current, &slice->base, slice);
+        }
+        value = function->new_value(IROp::Slice, current);
+        value->operands.push_back(base);
+        value->operands.insert(value->operands.end(), bounds.begin(), bounds.end());
+        uses.push_back({site, owner, value});
+        return value;
+    } else if (DictNode* dict = dynamic_cast<DictNode*>(node)) {
+        value = function->new_value(IROp::Dict, current);
+        for (size_t i = 0; i < dict->keys.size(); i++) {
+            value->operands.push_back(lower_expression(function, current, &dict->keys[i], dict));
+            value->operands.push_back(lower_expression(function, current, &dict->values[i], dict));
+        }
+        uses.push_back({site, owner, value});
+        return value;
+    } else if (RangeNode* range = dynamic_cast<RangeNode*>(node)) {
+        IRValue* from = lower_expression(function, current, &range->from, range);
+        IRValue* to = lower_expression(function, current, &range->to, range);
+        value = function->new_value(IROp::Range, current);
+        value->operands = {from, to};
+        uses.push_back({site, owner, value});
+        return value;
+    } else if (RecordNode* record = dynamic_cast<RecordNode*>(node)) {
+        value = function->new_value(IROp::Record, current);
+        for (ASTNode*& field : record->fields) {
+            value->operands.push_back(lower_expression(function, current, &field, record));
+        }
+        value->variable = record->layout->name;
+        uses.push_back({site, owner, value});
+        return value;
+    } else {
+        value = function->new_value(IROp::Opaque, current);
+        value->variable = node->print();
+        return value;
+    }
+    value->known = true;
+    value->type = value_type(value->constant);
+    return value;
+}
+
+static void collect_assigned(ASTNode* node, std::set<std::string>& written){
+    if (AssignmentNode* assignment = dynamic_cast<AssignmentNode*>(node)) {
+        if (IdentifierNode* id = dynamic_cast<IdentifierNode*>(assignment->id)) {
+            written.insert(id->name);
+        } else if (IndexNode* element = dynamic_cast<IndexNode*>(assignment->id)) {
+            written.insert(element->name);
+        }
+    } else if (TempStoreNode* store = dynamic_cast<TempStoreNode*>(node)) {
+        written.insert(store->name);
+    }
+    for (ASTNode** child : node->children()) {
+        collect_assigned(*child, written);
+    }
+}
+
+// An operand that is only evaluated on some paths is lowered in place, with
+// the variables as they were before it. What it assigns is collected so the
+// caller can forget those variables once all such operands are lowered.
+IRValue* IRProgram::lower_conditional(IRFunction* function, IRBlock* current, ASTNode** site, ASTNode* owner, std::set<std::string>& written){
+    std::map<std::string, IRValue*> before = current->definitions;
+    IRValue* value = lower_expression(function, current, site, owner);
+    collect_assigned(*site, written);
+    current->definitions = before;
+    return value;
+}
+
+// Variables that may or may not have been assigned hold an unknown value
+void IRProgram::forget(IRFunction* function, IRBlock* current, const std::set<std::string>& written){
+    for (const std::string& name : written) {
+        IRValue* unknown = function->new_value(IROp::Opaque, current);
+        unknown->variable = name;
+        write_variable(current, name, unknown);
+    }
+}
+
+//----------------------
+
+void IRProgram::write_variable(IRBlock* block, const std::string& name, IRValue* value){
+    block->definitions[name] = value;
+}
+
+IRValue* IRProgram::read_variable(IRFunction* function, IRBlock* block, const std::string& name){
+    auto found = block->definitions.find(name);
+    if (found != block->definitions.end()) {
+        return resolve(found->second);
+    }
+    return read_variable_recursive(function, block, name);
+}
+
+IRValue* IRProgram::read_variable_recursive(IRFunction* function, IRBlock* block, const std::string& name){
+    IRValue* value = nullptr;
+    if (!block->sealed) {
+        value = function->new_value(IROp::Phi, block);
+        value->variable = name;
+        block->incomplete_phis[name] = value;
+    } else if (block->predecessors.empty()) {
+        //whatever the environment holds when the function starts, possibly nothing
+        IRBlock* entry = function->blocks[0];
+        value = function->new_value(IROp::Entry, entry);
+        entry->instructions.pop_back();
+        entry->instructions.insert(entry->instructions.begin(), value);
+        value->variable = name;
+    } else if (block->predecessors.size() == 1) {
+        value = read_variable(function, block->predecessors[0], name);
+    } else {
+        IRValue* phi = function->new_value(IROp::Phi, block);
+        phi->variable = name;
+        write_variable(block, name, phi);
+        value = add_phi_operands(function, phi);
+    }
+    write_variable(block, name, value);
+    return value;
+}
+
+IRValue* IRProgram::add_phi_operands(IRFunction* function, IRValue* phi){
+    for (IRBlock* pred : phi->block->predecessors) {
+        phi->operands.push_back(read_variable(function, pred, phi->variable));
+    }
+    return try_remove_trivial_phi(phi);
+}
+
+IRValue* IRProgram::try_remove_trivial_phi(IRValue* phi){
+    IRValue* same = nullptr;
+    for (IRValue* operand : phi->operands) {
+        operand = resolve(operand);
+        if (operand == same || operand == phi) {
+            continue;
+        }
+        if (same != nullptr) {
+            return phi;
+        }
+        same = operand;
+    }
+    if (same == nullptr) {
+        return phi;
+    }
+    phi->replacement = same;
+    std::vector<IRValue*>& phis = phi->block->phis;
+    phis.erase(std::find(phis.begin(), phis.end(), phi));
+    return same;
+}
+
+void IRProgram::seal(IRFunction* function, IRBlock* block){
+    for (auto& incomplete : block->incomplete_phis) {
+        add_phi_operands(function, incomplete.second);
+    }
+    block->incomplete_phis.clear();
+    block->sealed = true;
+}
+
+// Removing one phi can make the phis using it trivial as well
+void IRProgram::remove_trivial_phis(IRFunction* function){
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (IRBlock* block : function->blocks) {
+            std::vector<IRValue*> phis(block->phis);
+            for (IRValue* phi : phis) {
+                if (try_remove_trivial_phi(phi) != phi) {
+                    changed = true;
+                }
+            }
+        }
+    }
+    for (IRBlock* block : function->blocks) {
+        for (IRValue* phi : block->phis) {
+            for (IRValue*& operand : phi->operands) {
+                operand = resolve(operand);
+            }
+        }
+        for (IRValue* value : block->instructions) {
+            for (IRValue*& operand : value->operands) {
+                operand = resolve(operand);
+            }
+        }
+        block->condition = resolve(block->condition);
+        block->returned = resolve(block->returned);
+    }
+}
+
+// A phi has a type when every value flowing into it has that same type
+void IRProgram::infer_phi_types(IRFunction* function){
+    std::map<IRValue*, bool> typed;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (IRBlock* block : function->blocks) {
+            for (IRValue* phi : block->phis) {
+                bool has_type = false;
+                IRType type = IRType::Unknown;
+                for (IRValue* operand : phi->operands) {
+                    if (operand->op == IROp::Phi && !typed[operand]) {
+                        continue;
+                    }
+                    if (!has_type) {
+                        type = operand->type;
+                        has_type = true;
+                    } else if (type != operand->type) {
+                        type = IRType::Unknown;
+                    }
+                }
+                if (has_type && (!typed[phi] || phi->type != type)) {
+                    if (typed[phi]) {
+                        type = IRType::Unknown;
+                    }
+                    changed = changed || !typed[phi] || phi->type != type;
+                    phi->type = type;
+                    typed[phi] = true;
+                }
+            }
+        }
+    }
+    for (IRBlock* block : function->blocks) {
+        for (IRValue* phi : block->phis) {
+            if (!typed[phi]) {
+                phi->type = IRType::Unknown;
+            }
+        }
+    }
+}
+
+//----------------------
+
+// Values whose operands are all known constants are computed once here.
+// Only ever moves values from unknown to known, so it terminates.
+void IRProgram::propagate_constants(){
+    for (IRFunction* function : functions) {
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (IRBlock* block : function->blocks) {
+                for (IRValue* phi : block->phis) {
+                    if (phi->known || phi->operands.empty()) {
+                        continue;
+                    }
+                    bool same = true;
+                    for (IRValue* operand : phi->operands) {
+                        if (!operand->known || !same_constant(operand->constant, phi->operands[0]->constant)) {
+                            same = false;
+                            break;
+                        }
+                    }
+                    if (same) {
+                        phi->constant = phi->operands[0]->constant;
+                        phi->known = true;
+                        changed = true;
+                    }
+                }
+                for (IRValue* value : block->instructions) {
+                    if (value->known) {
+                        continue;
+                    }
+                    if (value->op == IROp::Select) {
+                        IRValue* condition = value->operands[0];
+                        if (condition->known && condition->constant.type_tag == "bool") {
+                            IRValue* selected = value->operands[condition->constant.Bool ? 1 : 2];
+                            if (selected->known) {
+                                value->constant = selected->constant;
+                                value->known = true;
+                                changed = true;
+                            }
+                        }
+                        continue;
+                    }
+                    if (operator_node(value->op, nullptr, nullptr) == nullptr) {
+                        continue;
+                    }
+                    IRValue* left = value->operands[0];
+                    IRValue* right = value->operands[1];
+                    bool decided = (value->op == IROp::And || value->op == IROp::Or) && left->known
+                        && left->constant.type_tag == "bool" && left->constant.Bool == (value->op == IROp::Or);
+                    if (decided) {
+                        value->constant = left->constant;
+                        value->known = true;
+                        changed = true;
+                    } else if (left->known && right->known && fold_operation(value->op, left->constant, right->constant, value->constant)) {
+                        value->known = true;
+                        changed = true;
+                    }
+                }
+            }
+        }
+    }
+}
+
+// A select has a type when both values it chooses from have that same type.
+// Phis were typed before, treating every select as unknown, which only makes
+// them less precise.
+static void infer_select_types(IRFunction* function){
+    for (IRBlock* block : function->blocks) {
+        for (IRValue* value : block->instructions) {
+            if (value->op == IROp::Select) {
+                IRType taken = IRProgram::resolve(value->operands[1])->type;
+                IRType other = IRProgram::resolve(value->operands[2])->type;
+                value->type = taken == other ? taken : IRType::Unknown;
+            }
+        }
+    }
+}
+
+static ProvenType proven_type(IRType type){
+    switch (type) {
+        case IRType::Double:    return ProvenType::Double;
+        case IRType::Bool:      return ProvenType::Bool;
+        case IRType::Array:     return ProvenType::Array;
+        default:                return ProvenType::Unknown;
+    }
+}
+
+// Marks every tree expression with the type of the value it was lowered to.
+// SSA makes this flow-sensitive: a variable is proven at a read when every
+// assignment that can reach the read gives it that type.
+IRProgram::TypeReport IRProgram::infer_types(){
+    for (IRFunction* function : functions) {
+        infer_select_types(function);
+    }
+    TypeReport report;
+    std::set<ASTNode*> seen;
+    for (const TreeUse& use : uses) {
+        ASTNode* node = *use.site;
+        if (!seen.insert(node).second) {
+            continue;
+        }
+        node->proven = proven_type(resolve(use.value)->type);
+        ++report.expressions;
+        switch (node->proven) {
+            case ProvenType::Double:    ++report.doubles; break;
+            case ProvenType::Bool:      ++report.bools; break;
+            case ProvenType::Array:     ++report.arrays; break;
+            default:                    break;
+        }
+    }
+    return report;
+}
+
+// Writes what the IR knows back into the tree the interpreter runs: every
+// expression with a known value becomes a literal that still prints
+// as the original expression. Such a literal is no longer a read of the
+// variables it prints, so the passes after this one must not match
+// expressions on print() alone (see Optimizer::expression_key). Parents come
+// after their children in uses, so walking backwards replaces the largest
+// expression first.
+int IRProgram::lower_to_tree(){
+    int replaced = 0;
+    std::set<ASTNode*> removed;
+    for (auto use = uses.rbegin(); use != uses.rend(); ++use) {
+        if (use->owner != nullptr && removed.count(use->owner) != 0) {
+            continue;
+        }
+        IRValue* value = resolve(use->value);
+        ASTNode* node = *use->site;
+        if (!value->known || node->is_constant()) {
+            continue;
+        }
+        std::set<std::string> written;
+        collect_assigned(node, written);
+        if (!written.empty()) {
+            continue;   //the assignments still have to happen
+        }
+        ASTNode* literal = literal_node(value->constant, node->print());
+        if (literal == nullptr) {
+            continue;
+        }
+        std::vector<ASTNode*> subtree = {node};
+        while (!subtree.empty()) {
+            ASTNode* next = subtree.back();
+            subtree.pop_back();
+            removed.insert(next);
+            for (ASTNode** child : next->children()) {
+                subtree.push_back(*child);
+            }
+        }
+        delete node;
+        *use->site = literal;
+        ++replaced;
+    }
+    return replaced;
+}
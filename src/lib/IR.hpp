@@ -0,0 +1,118 @@
+#ifndef IR_HPP
+#define IR_HPP
+
+#include <map>
+#include <set>
+#include <ostream>
+
+#include "STree.hpp"
+
+// SSA intermediate representation of a scrypt program. The top level and every
+// function body become a control flow graph of basic blocks, `if` and `while`
+// become branches and back edges, and each assignment defines a new value.
+// Values of a variable that meet at a join are merged by phi nodes.
+//
+// The IR remembers which tree expression every value was lowered from, so what
+// a pass proves about the IR can be written back into the STree that scrypt
+// evaluates (lower_to_tree). A different backend would start from the blocks.
+
+enum class IRType { Unknown, Null, Double, Bool, Array, Dict, Record, Function };
+
+enum class IROp {
+    Constant, Entry, Parameter, Phi, Opaque,
+    Add, Subtract, Multiply, Divide, Modulo,
+    Less, LessEqual, More, MoreEqual, Equal, NotEqual, And, Xor, Or,
+    Index, SetIndex, Slice, Dict, Record, Field, Range, Next, Define, Call, Print, Select
+};
+
+struct IRBlock;
+class IRFunction;
+
+struct IRValue {
+    int id;
+    IROp op;
+    IRType type = IRType::Unknown;
+    std::vector<IRValue*> operands;
+    IRBlock* block = nullptr;
+    IRValue* replacement = nullptr; //set when a trivial phi is removed
+    std::string variable;           //variable defined or read, callee name for calls
+    value_bd constant;              //result, when known is set
+    bool known = false;
+    IRFunction* function = nullptr; //Define
+};
+
+struct IRBlock {
+    int id;
+    std::vector<IRValue*> phis;
+    std::vector<IRValue*> instructions;
+    std::vector<IRBlock*> predecessors;
+    std::vector<IRBlock*> successors;   //one for a jump, true and false targets for a branch
+    IRValue* condition = nullptr;
+    bool returns = false;
+    IRValue* returned = nullptr;
+    bool sealed = false;                //all predecessors are known
+    std::map<std::string, IRValue*> definitions;
+    std::map<std::string, IRValue*> incomplete_phis;
+};
+
+class IRFunction {
+public:
+    std::string name;
+    std::vector<std::string> parameters;
+    std::vector<IRBlock*> blocks;
+    std::vector<IRValue*> values;
+    ~IRFunction();
+    IRBlock* new_block();
+    IRValue* new_value(IROp op, IRBlock* block);
+    void dump(std::ostream& out);
+};
+
+class IRProgram {
+    // a tree expression that can be replaced by what the IR knows about its value
+    struct TreeUse {
+        ASTNode** site;
+        ASTNode* owner; //node holding the site, nullptr for the root of an ASTree
+        IRValue* value;
+    };
+    std::vector<IRFunction*> functions; //functions[0] is the top level
+    std::vector<TreeUse> uses;
+
+    IRFunction* lower_function(const std::string& name, const std::vector<std::string>& parameters, STree* code);
+    void lower_block(IRFunction* function, STree* tree, IRBlock*& current, bool function_level);
+    IRValue* lower_expression(IRFunction* function, IRBlock* current, ASTNode** site, ASTNode* owner);
+    IRValue* lower_call(IRFunction* function, IRBlock* current, function_call* call);
+    void lower_store(IRFunction* function, IRBlock* current, IndexNode* target, IRValue* value);
+    IRValue* lower_conditional(IRFunction* function, IRBlock* current, ASTNode** site, ASTNode* owner, std::set<std::string>& written);
+    void forget(IRFunction* function, IRBlock* current, const std::set<std::string>& written);
+    static void jump(IRBlock* from, IRBlock* to);
+
+    // SSA construction on the fly (Braun et al., "Simple and Efficient Construction of SSA Form")
+    void write_variable(IRBlock* block, const std::string& name, IRValue* value);
+    IRValue* read_variable(IRFunction* function, IRBlock* block, const std::string& name);
+    IRValue* read_variable_recursive(IRFunction* function, IRBlock* block, const std::string& name);
+    IRValue* add_phi_operands(IRFunction* function, IRValue* phi);
+    IRValue* try_remove_trivial_phi(IRValue* phi);
+    void seal(IRFunction* function, IRBlock* block);
+    void remove_trivial_phis(IRFunction* function);
+    static void infer_phi_types(IRFunction* function);
+
+public:
+    static IRValue* resolve(IRValue* value);
+
+    // expressions marked by infer_types, and how many of them were proven of each type
+    struct TypeReport {
+        int expressions = 0;
+        int doubles = 0;
+        int bools = 0;
+        int arrays = 0;
+    };
+
+    explicit IRProgram(STree* tree);
+    ~IRProgram();
+    void propagate_constants();
+    TypeReport infer_types();
+    int lower_to_tree();
+    void dump(std::ostream& out);
+};
+
+#endif
@@ -0,0 +1,60 @@
+#include "Memo.hpp"
+
+#include <cstring>
+
+MemoTable::MemoTable(std::string name, size_t capacity) : name(name), capacity(capacity) {}
+
+bool MemoTable::make_key(const std::vector<value_bd>& arguments, Key& key){
+    key.clear();
+    for (const value_bd& argument : arguments) {
+        uint64_t bits;
+        if (argument.type_tag == "double") {
+            std::memcpy(&bits, &argument.Double, sizeof(bits));
+            key.push_back(0);
+        } else if (argument.type_tag == "bool") {
+            bits = argument.Bool;
+            key.push_back(1);
+        } else {
+            return false;
+        }
+        key.push_back(bits);
+    }
+    return true;
+}
+
+const value_bd* MemoTable::find(const Key& key){
+    auto found = index.find(key);
+    if (found == index.end()) {
+        misses++;
+        return nullptr;
+    }
+    hits++;
+    entries.splice(entries.begin(), entries, found->second);
+    return &found->second->second;
+}
+
+void MemoTable::insert(const Key& key, const value_bd& value){
+    if (capacity == 0 || index.count(key) != 0) {
+        return;
+    }
+    if (entries.size() >= capacity) {
+        index.erase(entries.back().first);
+        entries.pop_back();
+        evictions++;
+    }
+    entries.push_front({key, value});
+    index[key] = entries.begin();
+}
+
+void MemoTable::clear(){
+    entries.clear();
+    index.clear();
+}
+
+size_t MemoTable::KeyHash::operator()(const Key& key) const{
+    size_t hash = key.size();
+    for (uint64_t word : key) {
+        hash ^= std::hash<uint64_t>()(word) + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+    }
+    return hash;
+}
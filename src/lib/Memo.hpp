@@ -0,0 +1,41 @@
+#ifndef MEMO_HPP
+#define MEMO_HPP
+
+#include <list>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <unordered_map>
+
+#include "value_bd.hpp"
+
+// Results of a pure function keyed on its arguments. Only numbers and
+// booleans make a key, compared bit for bit so that 0 and -0 stay apart.
+// Holds at most capacity results and evicts the least recently used one.
+class MemoTable {
+public:
+    typedef std::vector<uint64_t> Key;
+
+    std::string name;
+    size_t capacity;
+    unsigned long generation = 0;   //FuncNode::definitions when the table was filled
+    unsigned long hits = 0;
+    unsigned long misses = 0;
+    unsigned long evictions = 0;
+
+    MemoTable(std::string name, size_t capacity);
+    static bool make_key(const std::vector<value_bd>& arguments, Key& key);
+    const value_bd* find(const Key& key);
+    void insert(const Key& key, const value_bd& value);
+    void clear();
+
+private:
+    struct KeyHash {
+        size_t operator()(const Key& key) const;
+    };
+    typedef std::list<std::pair<Key, value_bd>> Entries;
+    Entries entries;                                    //most recently used first
+    std::unordered_map<Key, Entries::iterator, KeyHash> index;
+};
+
+#endif
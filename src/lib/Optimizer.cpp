@@ -0,0 +1,1427 @@
+#include "Optimizer.hpp"
+#include "IR.hpp"
+
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+void Optimizer::optimize(STree* tree){
+    if (options.inline_functions || options.specialize) {
+        std::multiset<std::string> writes;
+        collect_program_writes(tree, writes);
+        rewrite_calls(tree, {}, writes);
+    }
+    if (options.memoize) {
+        memoize_functions(tree);
+    }
+    {
+        IRProgram program(tree);
+        program.propagate_constants();
+        if (options.infer_types) {
+            IRProgram::TypeReport types = program.infer_types();
+            stats.typed = types.expressions;
+            stats.typed_double = types.doubles;
+            stats.typed_bool = types.bools;
+            stats.typed_array = types.arrays;
+        }
+        stats.constants = program.lower_to_tree();
+    }
+    eliminate_dead_code(tree);
+    eliminate_dead_stores(tree);
+    optimize_loops(tree);
+    eliminate_common_subexpressions(tree);
+}
+
+std::string Optimizer::temp_name(const std::string& prefix){
+    return "$" + prefix + std::to_string(temp_count++);
+}
+
+//----------------------
+
+// Collects the root of every expression evaluated by the statements of a block,
+// including nested blocks but not the bodies of functions defined in it
+void Optimizer::expression_sites(STree* tree, std::vector<ASTNode**>& sites){
+    if (tree == nullptr) {
+        return;
+    }
+    for (SNode* node = tree->head; node != nullptr; node = node->next) {
+        if (WhileNode* loop = dynamic_cast<WhileNode*>(node)) {
+            sites.push_back(&loop->expression->expression->head);
+            expression_sites(loop->trueBranch, sites);
+        } else if (IfNode* branch = dynamic_cast<IfNode*>(node)) {
+            sites.push_back(&branch->expression->expression->head);
+            expression_sites(branch->trueBranch, sites);
+            expression_sites(branch->falseBranch, sites);
+        } else if (dynamic_cast<FuncNode*>(node) == nullptr && node->expression != nullptr && node->expression->kind == ExpKind::Expression) {
+            sites.push_back(&node->expression->expression->head);
+        }
+    }
+}
+
+// Every variable a block may assign, counted once per assignment. Calls are
+// reported separately since they can re-enter code that is being optimized.
+void Optimizer::collect_writes(STree* tree, std::multiset<std::string>& writes, bool& calls){
+    if (tree == nullptr) {
+        return;
+    }
+    for (SNode* node = tree->head; node != nullptr; node = node->next) {
+        if (ForNode* each = dynamic_cast<ForNode*>(node)) {
+            writes.insert(each->variable);
+        }
+        if (WhileNode* loop = dynamic_cast<WhileNode*>(node)) {
+            collect_writes(loop->expression->expression->head, writes);
+            collect_writes(loop->trueBranch, writes, calls);
+        } else if (IfNode* branch = dynamic_cast<IfNode*>(node)) {
+            collect_writes(branch->expression->expression->head, writes);
+            collect_writes(branch->trueBranch, writes, calls);
+            collect_writes(branch->falseBranch, writes, calls);
+        } else if (FuncNode* func = dynamic_cast<FuncNode*>(node)) {
+            writes.insert(func->f_name);
+        } else if (node->expression != nullptr && node->expression->kind == ExpKind::Expression) {
+            collect_writes(node->expression->expression->head, writes);
+        } else if (node->expression != nullptr) {
+            calls = true;
+            if (node->expression->kind == ExpKind::FunctionAssigner) {
+                writes.insert(node->expression->target);
+            }
+            if (!node->expression->function->mutated().empty()) {
+                writes.insert(node->expression->function->mutated());
+            }
+        }
+    }
+}
+
+// With definite set, only assignments that happen whenever the expression is
+// evaluated are collected, leaving out operands that may be skipped
+void Optimizer::collect_writes(ASTNode* node, std::multiset<std::string>& writes, bool definite){
+    if (AssignmentNode* assignment = dynamic_cast<AssignmentNode*>(node)) {
+        writes.insert(assigned_name(assignment));
+    } else if (TempStoreNode* store = dynamic_cast<TempStoreNode*>(node)) {
+        writes.insert(store->name);
+    }
+    std::vector<ASTNode**> children = node->children();
+    if (definite && node->short_circuit() && !children.empty()) {
+        children.resize(1);
+    }
+    for (ASTNode** child : children) {
+        collect_writes(*child, writes, definite);
+    }
+}
+
+//----------------------
+
+bool Optimizer::is_candidate(ASTNode* node){
+    return dynamic_cast<IndexNode*>(node) != nullptr || dynamic_cast<OperatorNode*>(node) != nullptr;
+}
+
+// What CSE, hoisting and strength reduction match expressions on. print()
+// shows numbers to six digits and a literal the IR put in place of a
+// variable as that variable, so expressions with different values can print
+// the same; the key adds the exact value of every literal, in order.
+std::string Optimizer::expression_key(ASTNode* node){
+    std::ostringstream key;
+    key << std::setprecision(std::numeric_limits<double>::max_digits10);
+    key << node->print() << " |";
+    append_literals(node, key);
+    return key.str();
+}
+
+void Optimizer::append_literals(ASTNode* node, std::ostringstream& key){
+    if (NumberNode* number = dynamic_cast<NumberNode*>(node)) {
+        key << " " << number->value.Double;
+    } else if (BooleanNode* boolean = dynamic_cast<BooleanNode*>(node)) {
+        key << " " << (boolean->value.Bool ? "true" : "false");
+    }
+    for (ASTNode** child : node->children()) {
+        append_literals(*child, key);
+    }
+}
+
+bool Optimizer::is_pure(ASTNode* node){
+    if (dynamic_cast<AssignmentNode*>(node) != nullptr || dynamic_cast<TempStoreNode*>(node) != nullptr) {
+        return false;
+    }
+    for (ASTNode** child : node->children()) {
+        if (!is_pure(*child)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Optimizer::collect_inputs(ASTNode* node, std::set<std::string>& inputs){
+    if (IdentifierNode* id = dynamic_cast<IdentifierNode*>(node)) {
+        inputs.insert(id->name);
+    } else if (TempLoadNode* load = dynamic_cast<TempLoadNode*>(node)) {
+        inputs.insert(load->name);
+    } else if (InvariantNode* invariant = dynamic_cast<InvariantNode*>(node)) {
+        collect_inputs(invariant->expression, inputs);
+    } else if (ReducedProductNode* product = dynamic_cast<ReducedProductNode*>(node)) {
+        collect_inputs(product->product, inputs);
+    } else if (IndexNode* element = dynamic_cast<IndexNode*>(node)) {
+        if (!element->name.empty()) {
+            inputs.insert(element->name);
+        }
+    }
+    for (ASTNode** child : node->children()) {
+        collect_inputs(*child, inputs);
+    }
+}
+
+std::string Optimizer::assigned_name(AssignmentNode* node){
+    if (IdentifierNode* id = dynamic_cast<IdentifierNode*>(node->id)) {
+        return id->name;
+    } else if (IndexNode* element = dynamic_cast<IndexNode*>(node->id)) {
+        return element->name;
+    }
+    return "";
+}
+
+//----------------------
+
+// Value numbering over straight-line runs of expression statements. Identical
+// pure subtrees are keyed by their printed form; the first one is kept and
+// stores its value in a hidden temporary, later ones read it back. Any
+// statement other than a plain expression, print or return ends the run.
+void Optimizer::eliminate_common_subexpressions(STree* tree){
+    if (tree == nullptr) {
+        return;
+    }
+    for (SNode* node = tree->head; node != nullptr; node = node->next) {
+        if (WhileNode* loop = dynamic_cast<WhileNode*>(node)) {
+            end_run();
+            number_expression(&loop->expression->expression->head);
+            end_run();
+            eliminate_common_subexpressions(loop->trueBranch);
+        } else if (IfNode* branch = dynamic_cast<IfNode*>(node)) {
+            end_run();
+            number_expression(&branch->expression->expression->head);
+            end_run();
+            eliminate_common_subexpressions(branch->trueBranch);
+            eliminate_common_subexpressions(branch->falseBranch);
+        } else if (FuncNode* func = dynamic_cast<FuncNode*>(node)) {
+            end_run();
+            eliminate_common_subexpressions(func->code);
+        } else if (node->expression != nullptr && node->expression->kind == ExpKind::Expression) {
+            number_expression(&node->expression->expression->head);
+        } else {
+            end_run();
+        }
+    }
+    end_run();
+}
+
+// Visits a subtree in evaluation order. A subtree that is already available is
+// recorded as a use and not descended into, so the largest match wins.
+void Optimizer::number_expression(ASTNode** site){
+    ASTNode* node = *site;
+    if (AssignmentNode* assignment = dynamic_cast<AssignmentNode*>(node)) {
+        number_expression(&assignment->value);
+        kill(assigned_name(assignment));
+        return;
+    }
+    if (TempStoreNode* store = dynamic_cast<TempStoreNode*>(node)) {
+        number_expression(&store->expression);
+        kill(store->name);
+        return;
+    }
+    if (is_candidate(node) && is_pure(node)) {
+        std::string key = expression_key(node);
+        auto found = available.find(key);
+        if (found != available.end()) {
+            subexpressions[found->second].uses.push_back(site);
+            return;
+        }
+        if (conditional == 0) {
+            Subexpression subexpression;
+            subexpression.definition = site;
+            collect_inputs(node, subexpression.inputs);
+            available[key] = subexpressions.size();
+            subexpressions.push_back(subexpression);
+        }
+    }
+    std::vector<ASTNode**> children = node->children();
+    for (size_t i = 0; i < children.size(); i++) {
+        if (i == 1 && node->short_circuit()) {
+            conditional++;
+        }
+        number_expression(children[i]);
+    }
+    if (children.size() > 1 && node->short_circuit()) {
+        conditional--;
+    }
+}
+
+void Optimizer::kill(const std::string& name){
+    for (auto it = available.begin(); it != available.end();) {
+        if (subexpressions[it->second].inputs.count(name) != 0) {
+            it = available.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void Optimizer::end_run(){
+    for (Subexpression& subexpression : subexpressions) {
+        if (subexpression.uses.empty()) {
+            continue;
+        }
+        std::shared_ptr<value_bd> slot = std::make_shared<value_bd>();
+        std::string name = temp_name("t");
+        for (ASTNode** use : subexpression.uses) {
+            ProvenType proven = (*use)->proven;
+            delete *use;
+            *use = new TempLoadNode(slot, name);
+            (*use)->proven = proven;
+        }
+        *subexpression.definition = new TempStoreNode(slot, name, *subexpression.definition);
+    }
+    subexpressions.clear();
+    available.clear();
+}
+
+//----------------------
+
+// A call is inlined or specialized when the callee is statically known: its
+// def is the only assignment to that name in the whole program and has
+// already run in the block of the call or one enclosing it. Functions defined
+// later in that block see it too, through the map they copy when defined.
+void Optimizer::rewrite_calls(STree* tree, std::unordered_map<std::string, FuncNode*> known, const std::multiset<std::string>& writes){
+    if (tree == nullptr) {
+        return;
+    }
+    SNode** link = &tree->head;
+    while (*link != nullptr) {
+        SNode* node = *link;
+        SNode* after = node->next;
+        if (FuncNode* func = dynamic_cast<FuncNode*>(node)) {
+            std::unordered_map<std::string, FuncNode*> inner(known);
+            for (const std::string& parameter : func->parameters) {
+                inner.erase(parameter);
+            }
+            rewrite_calls(func->code, inner, writes);
+            if (writes.count(func->f_name) == 1) {
+                known[func->f_name] = func;
+            }
+        } else if (WhileNode* loop = dynamic_cast<WhileNode*>(node)) {
+            rewrite_calls(loop->trueBranch, known, writes);
+        } else if (IfNode* branch = dynamic_cast<IfNode*>(node)) {
+            rewrite_calls(branch->trueBranch, known, writes);
+            rewrite_calls(branch->falseBranch, known, writes);
+        } else if (node->expression != nullptr && node->expression->function != nullptr
+                   && known.count(node->expression->function->name) != 0) {
+            FuncNode* func = known[node->expression->function->name];
+            SNode* first = options.inline_functions ? inline_call(node, func, tree) : nullptr;
+            if (first != nullptr) {
+                *link = first;
+                while (*link != after) {
+                    link = &(*link)->next;
+                }
+                continue;
+            }
+            if (options.specialize) {
+                specialize_call(node->expression->function, func);
+            }
+        }
+        link = &node->next;
+    }
+}
+
+// Replaces a call statement by statements computing the same value. Bodies
+// made of assignments to locals followed by a return are inlined; parameters
+// and locals become hidden temporaries ($p0, $p1, ...) so the caller's
+// variables are untouched, and literal arguments are copied in and folded.
+// A body that reads anything else, or a local before assigning it, depends
+// on the function's own map and is left alone.
+SNode* Optimizer::inline_call(SNode* node, FuncNode* func, STree* tree){
+    function_call* call = node->expression->function;
+    if (func->code == nullptr || call->arguments.size() != func->parameters.size()) {
+        return nullptr;
+    }
+    IdentifierNode* target = nullptr;
+    if (node->expression->kind == ExpKind::FunctionAssigner) {
+        target = dynamic_cast<IdentifierNode*>(node->expression->expression->head);
+        if (target == nullptr) {
+            return nullptr;
+        }
+    }
+    Renaming names;
+    std::vector<Binding> parameters;
+    for (size_t i = 0; i < func->parameters.size(); i++) {
+        Binding binding;
+        if (call->arguments[i]->head->is_constant()) {
+            binding.literal = call->arguments[i]->head;
+        } else {
+            binding.slot = std::make_shared<value_bd>();
+            binding.name = temp_name("p");
+        }
+        parameters.push_back(binding);
+        names[func->parameters[i]] = binding;
+    }
+    std::vector<ASTNode*> locals;
+    ASTNode* result = nullptr;
+    bool inlinable = true;
+    for (SNode* statement = func->code->head; statement != nullptr && inlinable; statement = statement->next) {
+        if (dynamic_cast<ReturnNode*>(statement) != nullptr) {
+            if (statement->expression != nullptr && statement->expression->expression->print_no_endl() != "null") {
+                result = statement->expression->expression->head->clone();
+                inlinable = result != nullptr && substitute(&result, names);
+                if (inlinable) {
+                    result = result->fold();
+                }
+            }
+            break;
+        }
+        AssignmentNode* assignment = nullptr;
+        if (dynamic_cast<ExpressionNode*>(statement) != nullptr && statement->expression->kind == ExpKind::Expression) {
+            assignment = dynamic_cast<AssignmentNode*>(statement->expression->expression->head);
+        }
+        IdentifierNode* local = assignment != nullptr ? dynamic_cast<IdentifierNode*>(assignment->id) : nullptr;
+        if (local == nullptr) {
+            inlinable = false;
+            break;
+        }
+        ASTNode* value = assignment->value->clone();
+        inlinable = value != nullptr && substitute(&value, names);
+        if (inlinable) {
+            Binding binding;
+            binding.slot = std::make_shared<value_bd>();
+            binding.name = temp_name("p");
+            names[local->name] = binding;
+            locals.push_back(new TempStoreNode(binding.slot, binding.name, value->fold()));
+        } else {
+            delete value;
+        }
+    }
+    int size = count_nodes(result);
+    for (ASTNode* store : locals) {
+        size += count_nodes(store);
+    }
+    if (!inlinable || result == nullptr || size > options.inline_size || inlined_nodes + size > options.inline_growth) {
+        for (ASTNode* store : locals) {
+            delete store;
+        }
+        delete result;
+        return nullptr;
+    }
+    inlined_nodes += size;
+    stats.inlined++;
+
+    std::vector<SNode*> statements;
+    for (size_t i = 0; i < parameters.size(); i++) {
+        if (parameters[i].literal != nullptr) {
+            continue;
+        }
+        ASTNode* argument = call->arguments[i]->head;
+        call->arguments[i]->head = nullptr;
+        ASTNode* store = new TempStoreNode(parameters[i].slot, parameters[i].name, argument);
+        statements.push_back(new ExpressionNode(new EXP(new ASTree(store, tree->var_map)), nullptr));
+    }
+    for (ASTNode* store : locals) {
+        statements.push_back(new ExpressionNode(new EXP(new ASTree(store, tree->var_map)), nullptr));
+    }
+    if (dynamic_cast<PrintNode*>(node) != nullptr) {
+        statements.push_back(new PrintNode(new EXP(new ASTree(result, tree->var_map)), nullptr));
+    } else if (target != nullptr) {
+        ASTNode* assignment = new AssignmentNode(0, 0, target->clone(), result);
+        statements.push_back(new ExpressionNode(new EXP(new ASTree(assignment, tree->var_map)), nullptr));
+    } else {
+        statements.push_back(new ExpressionNode(new EXP(new ASTree(result, tree->var_map)), nullptr));
+    }
+    for (size_t i = 0; i + 1 < statements.size(); i++) {
+        statements[i]->next = statements[i + 1];
+    }
+    statements.back()->next = node->next;
+    node->next = nullptr;
+    delete node;
+    return statements.front();
+}
+
+// A call passing literals gets a copy of the callee's body with those
+// parameters replaced by the literals, then folded and pruned. Copies are
+// shared by all calls passing the same literals. The copy runs in the map of
+// the original function and is only used while the call resolves to it.
+void Optimizer::specialize_call(function_call* call, FuncNode* func){
+    if (func->code == nullptr || call->arguments.size() != func->parameters.size() || func->origin != nullptr) {
+        return;
+    }
+    std::set<std::string> assigned;
+    FuncNode::collect_locals(func->code, assigned);
+    std::unordered_map<std::string, ASTNode*> constants;
+    std::vector<std::string> parameters;
+    std::vector<size_t> kept;
+    std::string key;
+    for (size_t i = 0; i < call->arguments.size(); i++) {
+        ASTNode* argument = call->arguments[i]->head;
+        const std::string& parameter = func->parameters[i];
+        if (argument->is_constant() && assigned.count(parameter) == 0) {
+            value_bd value = argument->evaluate(nullptr);
+            std::ostringstream text;
+            text.precision(17);
+            if (value.type_tag == "bool") {
+                text << (value.Bool ? "true" : "false");
+            } else {
+                text << value.Double;
+            }
+            constants[parameter] = argument;
+            key += (key.empty() ? "" : ", ") + parameter + "=" + text.str();
+        } else {
+            parameters.push_back(parameter);
+            kept.push_back(i);
+        }
+    }
+    if (constants.empty()) {
+        return;
+    }
+    FuncNode* specialized = nullptr;
+    auto found = func->specializations.find(key);
+    if (found != func->specializations.end()) {
+        specialized = found->second.get();
+    } else {
+        if ((int)func->specializations.size() >= options.specializations) {
+            return;
+        }
+        STree* code = clone_block(func->code);
+        if (code == nullptr || !substitute_constants(code, constants) || count_nodes(code) > options.specialize_size) {
+            delete code;
+            return;
+        }
+        {
+            IRProgram program(code);
+            program.propagate_constants();
+            program.lower_to_tree();
+        }
+        eliminate_dead_code(code);
+        eliminate_dead_stores(code);
+        specialized = new FuncNode(nullptr, code, parameters, func->f_name + "<" + key + ">");
+        specialized->origin = func;
+        func->specializations[key].reset(specialized);
+        stats.specialized++;
+    }
+    call->expected = func;
+    call->specialized = specialized;
+    call->kept = kept;
+}
+
+STree* Optimizer::clone_block(STree* tree){
+    SNode* head = nullptr;
+    SNode** link = &head;
+    for (SNode* node = tree->head; node != nullptr; node = node->next) {
+        *link = clone_statement(node);
+        if (*link == nullptr) {
+            delete head;
+            return nullptr;
+        }
+        link = &(*link)->next;
+    }
+    return new STree(head, tree->var_map);
+}
+
+// Copies one statement without its successors, nullptr for a def or anything
+// holding a node that cannot be copied
+SNode* Optimizer::clone_statement(SNode* node){
+    EXP* expression = nullptr;
+    if (node->expression != nullptr) {
+        expression = clone_expression(node->expression);
+        if (expression == nullptr) {
+            return nullptr;
+        }
+    }
+    if (WhileNode* loop = dynamic_cast<WhileNode*>(node)) {
+        STree* body = clone_block(loop->trueBranch);
+        if (body == nullptr) {
+            delete expression;
+            return nullptr;
+        }
+        if (ForNode* each = dynamic_cast<ForNode*>(node)) {
+            return new ForNode(each->variable, expression, nullptr, body);
+        }
+        return new WhileNode(expression, nullptr, body);
+    } else if (IfNode* branch = dynamic_cast<IfNode*>(node)) {
+        STree* taken = clone_block(branch->trueBranch);
+        STree* other = branch->falseBranch != nullptr ? clone_block(branch->falseBranch) : nullptr;
+        if (taken == nullptr || (branch->falseBranch != nullptr && other == nullptr)) {
+            delete taken;
+            delete other;
+            delete expression;
+            return nullptr;
+        }
+        return new IfNode(expression, nullptr, taken, other);
+    } else if (dynamic_cast<PrintNode*>(node) != nullptr) {
+        return new PrintNode(expression, nullptr);
+    } else if (dynamic_cast<ReturnNode*>(node) != nullptr) {
+        return new ReturnNode(expression, nullptr);
+    } else if (dynamic_cast<ExpressionNode*>(node) != nullptr) {
+        return new ExpressionNode(expression, nullptr);
+    }
+    delete expression;
+    return nullptr;
+}
+
+EXP* Optimizer::clone_expression(EXP* expression){
+    ASTNode* head = nullptr;
+    if (expression->expression != nullptr) {
+        head = expression->expression->head->clone();
+        if (head == nullptr) {
+            return nullptr;
+        }
+    }
+    if (expression->kind == ExpKind::Expression) {
+        return new EXP(new ASTree(head, expression->expression->var_map));
+    }
+    std::vector<ASTree*> arguments;
+    for (ASTree* argument : expression->function->arguments) {
+        ASTNode* copy = argument->head->clone();
+        if (copy == nullptr) {
+            for (ASTree* done : arguments) {
+                delete done;
+            }
+            delete head;
+            return nullptr;
+        }
+        arguments.push_back(new ASTree(copy, argument->var_map));
+    }
+    function_call* call = new function_call(expression->function->name, arguments);
+    if (expression->kind == ExpKind::FunctionAssigner) {
+        return new EXP(head, call);
+    }
+    return new EXP(call);
+}
+
+// Replaces the parameters bound to literals in every expression of a block
+bool Optimizer::substitute_constants(STree* tree, const std::unordered_map<std::string, ASTNode*>& constants){
+    if (tree == nullptr) {
+        return true;
+    }
+    for (SNode* node = tree->head; node != nullptr; node = node->next) {
+        if (WhileNode* loop = dynamic_cast<WhileNode*>(node)) {
+            if (!substitute_constants(loop->trueBranch, constants)) {
+                return false;
+            }
+        } else if (IfNode* branch = dynamic_cast<IfNode*>(node)) {
+            if (!substitute_constants(branch->trueBranch, constants) || !substitute_constants(branch->falseBranch, constants)) {
+                return false;
+            }
+        }
+        if (node->expression == nullptr) {
+            continue;
+        }
+        std::vector<ASTree*> trees;
+        if (node->expression->expression != nullptr
+            && (node->expression->kind != ExpKind::FunctionAssigner || dynamic_cast<IndexNode*>(node->expression->expression->head) != nullptr)) {
+            trees.push_back(node->expression->expression);
+        }
+        if (node->expression->function != nullptr) {
+            trees.insert(trees.end(), node->expression->function->arguments.begin(), node->expression->function->arguments.end());
+        }
+        for (ASTree* expression : trees) {
+            if (!substitute_constants(&expression->head, constants)) {
+                return false;
+            }
+            expression->head = expression->head->fold();
+        }
+    }
+    return true;
+}
+
+bool Optimizer::substitute_constants(ASTNode** site, const std::unordered_map<std::string, ASTNode*>& constants){
+    ASTNode* node = *site;
+    if (IdentifierNode* id = dynamic_cast<IdentifierNode*>(node)) {
+        auto found = constants.find(id->name);
+        if (found != constants.end()) {
+            *site = found->second->clone();
+            delete node;
+        }
+        return true;
+    }
+    if (IndexNode* element = dynamic_cast<IndexNode*>(node)) {
+        if (constants.count(element->name) != 0) {
+            return false;
+        }
+    }
+    for (ASTNode** child : node->children()) {
+        if (!substitute_constants(child, constants)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int Optimizer::count_nodes(STree* tree){
+    int count = 0;
+    std::vector<ASTNode**> sites;
+    expression_sites(tree, sites);
+    for (ASTNode** site : sites) {
+        count += count_nodes(*site);
+    }
+    return count;
+}
+
+// Every name assigned or defined anywhere, function bodies included
+void Optimizer::collect_program_writes(STree* tree, std::multiset<std::string>& writes){
+    if (tree == nullptr) {
+        return;
+    }
+    for (SNode* node = tree->head; node != nullptr; node = node->next) {
+        if (ForNode* each = dynamic_cast<ForNode*>(node)) {
+            writes.insert(each->variable);
+        }
+        if (WhileNode* loop = dynamic_cast<WhileNode*>(node)) {
+            collect_program_writes(loop->trueBranch, writes);
+        } else if (IfNode* branch = dynamic_cast<IfNode*>(node)) {
+            collect_program_writes(branch->trueBranch, writes);
+            collect_program_writes(branch->falseBranch, writes);
+        } else if (FuncNode* func = dynamic_cast<FuncNode*>(node)) {
+            writes.insert(func->f_name);
+            collect_program_writes(func->code, writes);
+        }
+        if (node->expression == nullptr) {
+            continue;
+        }
+        if (node->expression->kind == ExpKind::FunctionAssigner) {
+            writes.insert(node->expression->target);
+        } else if (node->expression->expression != nullptr) {
+            collect_writes(node->expression->expression->head, writes);
+        }
+        if (node->expression->function != nullptr && !node->expression->function->mutated().empty()) {
+            writes.insert(node->expression->function->mutated());
+        }
+    }
+}
+
+bool Optimizer::substitute(ASTNode** site, const Renaming& names){
+    ASTNode* node = *site;
+    if (IdentifierNode* id = dynamic_cast<IdentifierNode*>(node)) {
+        if (id->name == "null") {
+            return true;
+        }
+        auto found = names.find(id->name);
+        if (found == names.end()) {
+            return false;
+        }
+        if (found->second.literal != nullptr) {
+            *site = found->second.literal->clone();
+        } else {
+            *site = new TempLoadNode(found->second.slot, found->second.name);
+        }
+        delete node;
+        return true;
+    }
+    if (dynamic_cast<AssignmentNode*>(node) != nullptr || dynamic_cast<IndexNode*>(node) != nullptr) {
+        return false;
+    }
+    for (ASTNode** child : node->children()) {
+        if (!substitute(child, names)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int Optimizer::count_nodes(ASTNode* node){
+    if (node == nullptr) {
+        return 0;
+    }
+    int count = 1;
+    for (ASTNode** child : node->children()) {
+        count += count_nodes(*child);
+    }
+    return count;
+}
+
+//----------------------
+
+// A function is pure when its result only depends on its arguments: it prints
+// nothing, defines nothing, calls only pure functions and never reads one of
+// its own variables before assigning it in the same call, since that would
+// see what an earlier call left in the function's map. Variables it reads
+// but never assigns were copied when it was defined and cannot change.
+// Only pure functions that can call themselves get a memo table; for the
+// others a lookup costs about as much as running the body.
+void Optimizer::memoize_functions(STree* tree){
+    std::vector<FuncNode*> functions;
+    collect_functions(tree, functions);
+    std::multiset<std::string> writes;
+    collect_program_writes(tree, writes);
+    std::unordered_map<std::string, FuncNode*> unique;
+    for (FuncNode* func : functions) {
+        if (writes.count(func->f_name) == 1) {
+            unique[func->f_name] = func;
+        }
+    }
+    std::set<FuncNode*> pure;
+    std::unordered_map<FuncNode*, std::set<FuncNode*>> calls;
+    for (FuncNode* func : functions) {
+        if (func->code == nullptr) {
+            continue;
+        }
+        std::set<std::string> locals(func->parameters.begin(), func->parameters.end());
+        FuncNode::collect_locals(func->code, locals);
+        std::set<std::string> assigned(func->parameters.begin(), func->parameters.end());
+        if (is_pure(func->code, locals, assigned, unique, calls[func])) {
+            pure.insert(func);
+        }
+    }
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto it = pure.begin(); it != pure.end();) {
+            bool calls_impure = false;
+            for (FuncNode* callee : calls[*it]) {
+                calls_impure = calls_impure || pure.count(callee) == 0;
+            }
+            if (calls_impure) {
+                it = pure.erase(it);
+                changed = true;
+            } else {
+                ++it;
+            }
+        }
+    }
+    for (FuncNode* func : pure) {
+        std::set<FuncNode*> reached;
+        std::vector<FuncNode*> pending(calls[func].begin(), calls[func].end());
+        while (!pending.empty() && reached.count(func) == 0) {
+            FuncNode* next = pending.back();
+            pending.pop_back();
+            if (reached.insert(next).second) {
+                pending.insert(pending.end(), calls[next].begin(), calls[next].end());
+            }
+        }
+        if (reached.count(func) != 0) {
+            func->memo.reset(new MemoTable(func->f_name, options.memo_size));
+            stats.memoized.push_back(func->memo.get());
+        }
+    }
+}
+
+void Optimizer::collect_functions(STree* tree, std::vector<FuncNode*>& functions){
+    if (tree == nullptr) {
+        return;
+    }
+    for (SNode* node = tree->head; node != nullptr; node = node->next) {
+        if (WhileNode* loop = dynamic_cast<WhileNode*>(node)) {
+            collect_functions(loop->trueBranch, functions);
+        } else if (IfNode* branch = dynamic_cast<IfNode*>(node)) {
+            collect_functions(branch->trueBranch, functions);
+            collect_functions(branch->falseBranch, functions);
+        } else if (FuncNode* func = dynamic_cast<FuncNode*>(node)) {
+            functions.push_back(func);
+            collect_functions(func->code, functions);
+        }
+    }
+}
+
+// Walks a block of a function body in evaluation order. assigned holds the
+// variables assigned on every path so far; a loop body is checked as its first
+// iteration and adds nothing after the loop, since it may not run at all.
+bool Optimizer::is_pure(STree* tree, const std::set<std::string>& locals, std::set<std::string>& assigned, const std::unordered_map<std::string, FuncNode*>& unique, std::set<FuncNode*>& callees){
+    if (tree == nullptr) {
+        return true;
+    }
+    for (SNode* node = tree->head; node != nullptr; node = node->next) {
+        if (dynamic_cast<PrintNode*>(node) != nullptr || dynamic_cast<FuncNode*>(node) != nullptr) {
+            return false;
+        }
+        EXP* expression = node->expression;
+        if (expression == nullptr) {
+            if (dynamic_cast<ReturnNode*>(node) != nullptr) {
+                return true;
+            }
+            continue;
+        }
+        if (expression->kind == ExpKind::Expression) {
+            ASTNode* head = expression->expression->head;
+            if (!reads_assigned(head, locals, assigned)) {
+                return false;
+            }
+            std::multiset<std::string> writes;
+            collect_writes(head, writes, true);
+            assigned.insert(writes.begin(), writes.end());
+        } else {
+            function_call* call = expression->function;
+            auto callee = unique.find(call->name);
+            if (locals.count(call->name) != 0 || callee == unique.end()) {
+                return false;
+            }
+            callees.insert(callee->second);
+            for (ASTree* argument : call->arguments) {
+                if (!reads_assigned(argument->head, locals, assigned)) {
+                    return false;
+                }
+            }
+            if (expression->kind == ExpKind::FunctionAssigner) {
+                //an element written reads the array it is in
+                if (dynamic_cast<IndexNode*>(expression->expression->head) != nullptr && !reads_assigned(expression->expression->head, locals, assigned)) {
+                    return false;
+                }
+                assigned.insert(expression->target);
+            }
+        }
+        if (WhileNode* loop = dynamic_cast<WhileNode*>(node)) {
+            std::set<std::string> first(assigned);
+            if (ForNode* each = dynamic_cast<ForNode*>(node)) {
+                first.insert(each->variable);
+            }
+            if (!is_pure(loop->trueBranch, locals, first, unique, callees)) {
+                return false;
+            }
+        } else if (IfNode* branch = dynamic_cast<IfNode*>(node)) {
+            std::set<std::string> taken(assigned);
+            std::set<std::string> other(assigned);
+            if (!is_pure(branch->trueBranch, locals, taken, unique, callees)
+                || !is_pure(branch->falseBranch, locals, other, unique, callees)) {
+                return false;
+            }
+            for (const std::string& name : taken) {
+                if (other.count(name) != 0) {
+                    assigned.insert(name);
+                }
+            }
+        } else if (dynamic_cast<ReturnNode*>(node) != nullptr) {
+            return true;
+        }
+    }
+    return true;
+}
+
+bool Optimizer::reads_assigned(ASTNode* node, const std::set<std::string>& locals, const std::set<std::string>& assigned){
+    std::set<std::string> reads;
+    collect_reads(node, reads);
+    for (const std::string& name : reads) {
+        if (locals.count(name) != 0 && assigned.count(name) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//----------------------
+
+// Drops statements that follow a return in the same block and branches whose
+// condition is a literal. A taken branch is spliced into the enclosing block
+// unless it holds a return, which would then end the enclosing block as well;
+// otherwise only the other branch goes.
+void Optimizer::eliminate_dead_code(STree* tree){
+    if (tree == nullptr) {
+        return;
+    }
+    SNode** link = &tree->head;
+    while (*link != nullptr) {
+        SNode* node = *link;
+        if (dynamic_cast<ReturnNode*>(node) != nullptr) {
+            stats.unreachable += count_statements(node->next);
+            delete node->next;
+            node->next = nullptr;
+            break;
+        }
+        if (IfNode* branch = dynamic_cast<IfNode*>(node)) {
+            eliminate_dead_code(branch->trueBranch);
+            eliminate_dead_code(branch->falseBranch);
+            BooleanNode* condition = dynamic_cast<BooleanNode*>(branch->expression->expression->head);
+            if (condition != nullptr) {
+                STree* taken = condition->value.Bool ? branch->trueBranch : branch->falseBranch;
+                STree* other = condition->value.Bool ? branch->falseBranch : branch->trueBranch;
+                if (other != nullptr) {
+                    stats.branches += count_statements(other->head);
+                    delete other->head;
+                    other->head = nullptr;
+                }
+                if (can_splice(taken)) {
+                    SNode* first = node->next;
+                    if (taken != nullptr && taken->head != nullptr) {
+                        first = taken->head;
+                        SNode* last = first;
+                        while (last->next != nullptr) {
+                            last = last->next;
+                        }
+                        last->next = node->next;
+                        taken->head = nullptr;
+                    }
+                    node->next = nullptr;
+                    *link = first;
+                    delete node;
+                    stats.branches++;
+                    continue;
+                }
+            }
+        } else if (WhileNode* loop = dynamic_cast<WhileNode*>(node)) {
+            eliminate_dead_code(loop->trueBranch);
+            BooleanNode* condition = dynamic_cast<BooleanNode*>(loop->expression->expression->head);
+            if (condition != nullptr && !condition->value.Bool && loop->kind == StatementKind::While) {
+                stats.branches += 1 + count_statements(loop->trueBranch->head);
+                *link = node->next;
+                node->next = nullptr;
+                delete node;
+                continue;
+            }
+        } else if (FuncNode* func = dynamic_cast<FuncNode*>(node)) {
+            eliminate_dead_code(func->code);
+        }
+        link = &node->next;
+    }
+}
+
+bool Optimizer::can_splice(STree* branch){
+    if (branch == nullptr) {
+        return true;
+    }
+    for (SNode* node = branch->head; node != nullptr; node = node->next) {
+        if (dynamic_cast<ReturnNode*>(node) != nullptr) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// An assignment is a dead store when a later statement of the same straight-line
+// run assigns the variable again before anything reads it. It is only removed
+// when evaluating its value cannot fail, so no error goes missing. Definitions,
+// calls, returns and control flow may read any variable and end the run.
+void Optimizer::eliminate_dead_stores(STree* tree){
+    if (tree == nullptr) {
+        return;
+    }
+    std::unordered_map<std::string, SNode*> pending;   //variable -> last store not read yet
+    std::set<std::string> defined;     //assigned earlier, so reading it cannot fail
+    std::set<SNode*> dead;
+    for (SNode* node = tree->head; node != nullptr; node = node->next) {
+        if (WhileNode* loop = dynamic_cast<WhileNode*>(node)) {
+            eliminate_dead_stores(loop->trueBranch);
+        } else if (IfNode* branch = dynamic_cast<IfNode*>(node)) {
+            eliminate_dead_stores(branch->trueBranch);
+            eliminate_dead_stores(branch->falseBranch);
+        } else if (FuncNode* func = dynamic_cast<FuncNode*>(node)) {
+            eliminate_dead_stores(func->code);
+        }
+        bool expression = node->expression != nullptr && node->expression->kind == ExpKind::Expression;
+        if (!expression || dynamic_cast<ReturnNode*>(node) != nullptr
+            || dynamic_cast<WhileNode*>(node) != nullptr || dynamic_cast<IfNode*>(node) != nullptr) {
+            pending.clear();
+            continue;
+        }
+        ASTNode* head = node->expression->expression->head;
+        std::set<std::string> reads;
+        collect_reads(head, reads);
+        for (const std::string& name : reads) {
+            pending.erase(name);
+        }
+        std::multiset<std::string> writes;
+        collect_writes(head, writes);
+        std::multiset<std::string> definite;
+        collect_writes(head, definite, true);
+        AssignmentNode* store = dynamic_cast<AssignmentNode*>(head);
+        IdentifierNode* target = store != nullptr ? dynamic_cast<IdentifierNode*>(store->id) : nullptr;
+        if (target != nullptr && pending.count(target->name) != 0) {
+            dead.insert(pending[target->name]);
+        }
+        for (const std::string& name : writes) {
+            pending.erase(name);
+        }
+        if (target != nullptr && dynamic_cast<PrintNode*>(node) == nullptr && cannot_fail(store->value, defined)) {
+            pending[target->name] = node;
+        }
+        defined.insert(definite.begin(), definite.end());
+    }
+    SNode** link = &tree->head;
+    while (*link != nullptr) {
+        SNode* node = *link;
+        if (dead.count(node) != 0) {
+            *link = node->next;
+            node->next = nullptr;
+            delete node;
+            stats.dead_stores++;
+        } else {
+            link = &node->next;
+        }
+    }
+}
+
+bool Optimizer::cannot_fail(ASTNode* node, const std::set<std::string>& defined){
+    if (node->is_constant()) {
+        return true;
+    }
+    if (IdentifierNode* id = dynamic_cast<IdentifierNode*>(node)) {
+        return id->name == "null" || defined.count(id->name) != 0;
+    }
+    return dynamic_cast<ArrayNode*>(node) != nullptr;
+}
+
+// Like collect_inputs, but the variable an assignment stores to is not a read
+void Optimizer::collect_reads(ASTNode* node, std::set<std::string>& reads){
+    if (AssignmentNode* assignment = dynamic_cast<AssignmentNode*>(node)) {
+        if (dynamic_cast<IdentifierNode*>(assignment->id) == nullptr) {
+            collect_reads(assignment->id, reads);
+        }
+        collect_reads(assignment->value, reads);
+        return;
+    }
+    if (IdentifierNode* id = dynamic_cast<IdentifierNode*>(node)) {
+        reads.insert(id->name);
+    } else if (IndexNode* element = dynamic_cast<IndexNode*>(node)) {
+        reads.insert(element->name);
+    }
+    for (ASTNode** child : node->children()) {
+        collect_reads(*child, reads);
+    }
+}
+
+// Statements in a chain, including the ones in nested blocks and function bodies
+int Optimizer::count_statements(SNode* node){
+    int count = 0;
+    for (; node != nullptr; node = node->next) {
+        count++;
+        if (WhileNode* loop = dynamic_cast<WhileNode*>(node)) {
+            count += count_statements(loop->trueBranch->head);
+        } else if (IfNode* branch = dynamic_cast<IfNode*>(node)) {
+            count += count_statements(branch->trueBranch->head);
+            if (branch->falseBranch != nullptr) {
+                count += count_statements(branch->falseBranch->head);
+            }
+        } else if (FuncNode* func = dynamic_cast<FuncNode*>(node)) {
+            if (func->code != nullptr) {
+                count += count_statements(func->code->head);
+            }
+        }
+    }
+    return count;
+}
+
+//----------------------
+
+void Optimizer::optimize_loops(STree* tree){
+    if (tree == nullptr) {
+        return;
+    }
+    for (SNode* node = tree->head; node != nullptr; node = node->next) {
+        if (WhileNode* loop = dynamic_cast<WhileNode*>(node)) {
+            optimize_loop(loop);
+            optimize_loops(loop->trueBranch);
+        } else if (IfNode* branch = dynamic_cast<IfNode*>(node)) {
+            optimize_loops(branch->trueBranch);
+            optimize_loops(branch->falseBranch);
+        } else if (FuncNode* func = dynamic_cast<FuncNode*>(node)) {
+            optimize_loops(func->code);
+        }
+    }
+}
+
+// Outer loops are handled before the loops nested in them, so an expression
+// is hoisted as far out as its inputs allow. Loops that call functions are
+// left alone because a recursive call could run the same loop with other values.
+void Optimizer::optimize_loop(WhileNode* loop){
+    std::multiset<std::string> writes;
+    bool calls = false;
+    collect_writes(loop->expression->expression->head, writes);
+    collect_writes(loop->trueBranch, writes, calls);
+    if (calls) {
+        return;
+    }
+    ForNode* each = dynamic_cast<ForNode*>(loop);
+    if (each != nullptr) {
+        writes.insert(each->variable);
+    }
+    if (options.bounds_checks) {
+        eliminate_bounds_checks(loop, writes);
+    }
+    std::set<std::string> written(writes.begin(), writes.end());
+    std::vector<ASTNode**> sites;
+    if (each == nullptr) {
+        sites.push_back(&loop->expression->expression->head); //a for header is evaluated once anyway
+    }
+    expression_sites(loop->trueBranch, sites);
+    std::unordered_map<std::string, InvariantNode*> hoisted;
+    for (ASTNode** site : sites) {
+        hoist_invariants(site, written, loop, hoisted);
+    }
+
+    //induction variables: assigned once per iteration as v = v + c or v = v - c
+    for (SNode* node = loop->trueBranch ? loop->trueBranch->head : nullptr; node != nullptr; node = node->next) {
+        if (dynamic_cast<ExpressionNode*>(node) == nullptr || node->expression->kind != ExpKind::Expression) {
+            continue;
+        }
+        ASTNode** step_site = &node->expression->expression->head;
+        AssignmentNode* assignment = dynamic_cast<AssignmentNode*>(*step_site);
+        if (assignment == nullptr) {
+            continue;
+        }
+        std::string variable = assigned_name(assignment);
+        IdentifierNode* target = dynamic_cast<IdentifierNode*>(assignment->id);
+        if (target == nullptr || writes.count(variable) != 1) {
+            continue;
+        }
+        OperatorNode* update = dynamic_cast<OperatorNode*>(assignment->value);
+        if (update == nullptr || (dynamic_cast<AdditionNode*>(update) == nullptr && dynamic_cast<SubtractionNode*>(update) == nullptr)) {
+            continue;
+        }
+        IdentifierNode* self = dynamic_cast<IdentifierNode*>(update->left);
+        NumberNode* amount = dynamic_cast<NumberNode*>(update->right);
+        if (dynamic_cast<AdditionNode*>(update) != nullptr && (self == nullptr || amount == nullptr)) {
+            self = dynamic_cast<IdentifierNode*>(update->right);
+            amount = dynamic_cast<NumberNode*>(update->left);
+        }
+        if (self == nullptr || amount == nullptr || self->name != variable) {
+            continue;
+        }
+        double increment = amount->value.Double;
+        if (dynamic_cast<SubtractionNode*>(update) != nullptr) {
+            increment = -increment;
+        }
+        std::unordered_map<std::string, ReducedProductNode*> reduced;
+        std::vector<ReducedProductNode*> products;
+        for (ASTNode** site : sites) {
+            reduce_products(site, variable, increment, written, reduced, products);
+        }
+        if (!products.empty()) {
+            *step_site = new InductionStepNode(*step_site, products);
+            loop->products.insert(loop->products.end(), products.begin(), products.end());
+        }
+    }
+}
+
+// Runs before hoisting so the condition and indexes are still plain variables
+// and literals. The loop must end with its only assignment to the counter,
+// i = i + c for a positive integer c, and the other statements read a[i + k]
+// with i at a value that passed the condition. A for loop over a range counts
+// by one on its own as long as the body does not assign the variable. Accesses
+// already covered by an enclosing loop keep that loop's guard.
+void Optimizer::eliminate_bounds_checks(WhileNode* loop, const std::multiset<std::string>& writes){
+    if (loop->trueBranch == nullptr || loop->trueBranch->head == nullptr) {
+        return;
+    }
+    std::string counter;
+    std::string bound;
+    double limit = 0;
+    bool inclusive = false;
+    if (ForNode* each = dynamic_cast<ForNode*>(loop)) {
+        if (dynamic_cast<RangeNode*>(loop->expression->expression->head) == nullptr || writes.count(each->variable) != 1) {
+            return;
+        }
+        counter = each->variable;
+    } else if (!counted_loop(loop, writes, counter, bound, limit, inclusive)) {
+        return;
+    }
+
+    std::vector<ASTNode**> sites;
+    expression_sites(loop->trueBranch, sites);
+    std::vector<IndexNode*> accesses;
+    for (ASTNode** site : sites) {
+        collect_accesses(*site, counter, accesses);
+    }
+    //one guard per array, covering every offset it is read or written at
+    std::map<std::string, size_t> guarded;
+    std::vector<BoundsGuard> guards;
+    for (IndexNode* access : accesses) {
+        const std::string& array = access->name;
+        if (array == counter || (!bound.empty() && array == bound)) {
+            continue;
+        }
+        //element writes keep the length, anything else assigning the array does not
+        int element_writes = 0;
+        for (ASTNode** site : sites) {
+            element_writes += count_element_writes(*site, array);
+        }
+        if ((int)writes.count(array) != element_writes) {
+            continue;
+        }
+        double offset = 0;
+        if (OperatorNode* shifted = dynamic_cast<OperatorNode*>(access->index)) {
+            offset = static_cast<NumberNode*>(shifted->right)->value.Double;
+            if (dynamic_cast<SubtractionNode*>(shifted) != nullptr) {
+                offset = -offset;
+            }
+        }
+        auto found = guarded.find(array);
+        if (found == guarded.end()) {
+            BoundsGuard guard;
+            guard.array = array;
+            guard.variable = counter;
+            guard.bound = bound;
+            guard.limit = limit;
+            guard.inclusive = inclusive;
+            guard.min_offset = offset;
+            guard.max_offset = offset;
+            guard.check = std::make_shared<BoundsCheck>();
+            found = guarded.emplace(array, guards.size()).first;
+            guards.push_back(guard);
+        }
+        BoundsGuard& guard = guards[found->second];
+        guard.min_offset = std::min(guard.min_offset, offset);
+        guard.max_offset = std::max(guard.max_offset, offset);
+        access->bounds = guard.check;
+        ++stats.bounds_checks;
+    }
+    loop->guards.insert(loop->guards.end(), guards.begin(), guards.end());
+}
+
+// The counter of a while loop stepped as i = i + c by its last statement and
+// checked against a variable or literal by its condition
+bool Optimizer::counted_loop(WhileNode* loop, const std::multiset<std::string>& writes, std::string& counter_name, std::string& bound_name, double& limit_value, bool& inclusive){
+    OperatorNode* condition = dynamic_cast<LessNode*>(loop->expression->expression->head);
+    inclusive = false;
+    if (condition == nullptr) {
+        condition = dynamic_cast<LessEqualNode*>(loop->expression->expression->head);
+        inclusive = true;
+    }
+    if (condition == nullptr) {
+        return false;
+    }
+    IdentifierNode* counter = dynamic_cast<IdentifierNode*>(condition->left);
+    IdentifierNode* bound = dynamic_cast<IdentifierNode*>(condition->right);
+    NumberNode* limit = dynamic_cast<NumberNode*>(condition->right);
+    if (counter == nullptr || (bound == nullptr && limit == nullptr) || writes.count(counter->name) != 1) {
+        return false;
+    }
+    if (bound != nullptr && (writes.count(bound->name) != 0 || bound->name == counter->name)) {
+        return false;
+    }
+
+    SNode* last = loop->trueBranch->head;
+    while (last->next != nullptr) {
+        last = last->next;
+    }
+    if (last->kind != StatementKind::Expression || last->expression->kind != ExpKind::Expression) {
+        return false;
+    }
+    AssignmentNode* step = dynamic_cast<AssignmentNode*>(last->expression->expression->head);
+    IdentifierNode* target = step ? dynamic_cast<IdentifierNode*>(step->id) : nullptr;
+    AdditionNode* update = step ? dynamic_cast<AdditionNode*>(step->value) : nullptr;
+    if (target == nullptr || update == nullptr || target->name != counter->name) {
+        return false;
+    }
+    IdentifierNode* self = dynamic_cast<IdentifierNode*>(update->left);
+    NumberNode* amount = dynamic_cast<NumberNode*>(update->right);
+    if (self == nullptr || amount == nullptr) {
+        self = dynamic_cast<IdentifierNode*>(update->right);
+        amount = dynamic_cast<NumberNode*>(update->left);
+    }
+    if (self == nullptr || amount == nullptr || self->name != counter->name || amount->value.Double < 1 || std::floor(amount->value.Double) != amount->value.Double) {
+        return false;
+    }
+    counter_name = counter->name;
+    bound_name = bound != nullptr ? bound->name : "";
+    limit_value = limit != nullptr ? limit->value.Double : 0;
+    return true;
+}
+
+// Element accesses indexed by the variable, by the variable plus or minus an
+// integer literal, that no enclosing loop has claimed
+void Optimizer::collect_accesses(ASTNode* node, const std::string& variable, std::vector<IndexNode*>& accesses){
+    //element writes check their index themselves and fail on one out of range
+    if (AssignmentNode* assignment = dynamic_cast<AssignmentNode*>(node)) {
+        if (IndexNode* target = dynamic_cast<IndexNode*>(assignment->id)) {
+            for (IndexNode* level = target; level != nullptr; level = dynamic_cast<IndexNode*>(level->base)) {
+                if (level->index != nullptr) {
+                    collect_accesses(level->index, variable, accesses);
+                }
+            }
+            collect_accesses(assignment->value, variable, accesses);
+            return;
+        }
+    }
+    IndexNode* array = dynamic_cast<IndexNode*>(node);
+    if (array != nullptr && array->by_name && array->bounds == nullptr) {
+        IdentifierNode* id = dynamic_cast<IdentifierNode*>(array->index);
+        OperatorNode* shifted = nullptr;
+        if (dynamic_cast<AdditionNode*>(array->index) != nullptr || dynamic_cast<SubtractionNode*>(array->index) != nullptr) {
+            shifted = static_cast<OperatorNode*>(array->index);
+            id = dynamic_cast<IdentifierNode*>(shifted->left);
+            NumberNode* offset = dynamic_cast<NumberNode*>(shifted->right);
+            if (offset == nullptr || std::floor(offset->value.Double) != offset->value.Double) {
+                id = nullptr;
+            }
+        }
+        if (id != nullptr && id->name == variable) {
+            accesses.push_back(array);
+        }
+    }
+    for (ASTNode** child : node->children()) {
+        collect_accesses(*child, variable, accesses);
+    }
+}
+
+int Optimizer::count_element_writes(ASTNode* node, const std::string& name){
+    int count = 0;
+    if (AssignmentNode* assignment = dynamic_cast<AssignmentNode*>(node)) {
+        IndexNode* element = dynamic_cast<IndexNode*>(assignment->id);
+        if (element != nullptr && element->name == name) {
+            ++count;
+        }
+    }
+    for (ASTNode** child : node->children()) {
+        count += count_element_writes(*child, name);
+    }
+    return count;
+}
+
+void Optimizer::hoist_invariants(ASTNode** site, const std::set<std::string>& written, WhileNode* loop, std::unordered_map<std::string, InvariantNode*>& hoisted){
+    ASTNode* node = *site;
+    if (AssignmentNode* assignment = dynamic_cast<AssignmentNode*>(node)) {
+        hoist_invariants(&assignment->value, written, loop, hoisted);
+        return;
+    }
+    if (is_candidate(node) && is_pure(node)) {
+        std::set<std::string> inputs;
+        collect_inputs(node, inputs);
+        bool invariant = !inputs.empty();
+        for (const std::string& input : inputs) {
+            if (written.count(input) != 0) {
+                invariant = false;
+                break;
+            }
+        }
+        if (invariant) {
+            std::string key = expression_key(node);
+            auto found = hoisted.find(key);
+            if (found != hoisted.end()) {
+                *site = new InvariantNode(found->second->name, node, found->second->cache);
+            } else {
+                InvariantNode* first = new InvariantNode(temp_name("inv"), node, std::make_shared<InvariantCache>());
+                hoisted[key] = first;
+                loop->invariants.push_back(first);
+                *site = first;
+            }
+            return;
+        }
+    }
+    for (ASTNode** child : node->children()) {
+        hoist_invariants(child, written, loop, hoisted);
+    }
+}
+
+void Optimizer::reduce_products(ASTNode** site, const std::string& variable, double increment, const std::set<std::string>& written, std::unordered_map<std::string, ReducedProductNode*>& reduced, std::vector<ReducedProductNode*>& products){
+    ASTNode* node = *site;
+    if (AssignmentNode* assignment = dynamic_cast<AssignmentNode*>(node)) {
+        reduce_products(&assignment->value, variable, increment, written, reduced, products);
+        return;
+    }
+    if (MultiplicationNode* product = dynamic_cast<MultiplicationNode*>(node)) {
+        for (int side = 0; side < 2; ++side) {
+            IdentifierNode* id = dynamic_cast<IdentifierNode*>(side == 0 ? product->left : product->right);
+            ASTNode* factor = side == 0 ? product->right : product->left;
+            IdentifierNode* factor_id = dynamic_cast<IdentifierNode*>(factor);
+            bool invariant_factor = dynamic_cast<NumberNode*>(factor) != nullptr || (factor_id != nullptr && written.count(factor_id->name) == 0);
+            if (id != nullptr && id->name == variable && invariant_factor) {
+                std::string key = expression_key(product);
+                auto found = reduced.find(key);
+                if (found != reduced.end()) {
+                    *site = new ReducedProductNode(product, side == 0, found->second->state);
+                } else {
+                    std::shared_ptr<ReducedProduct> state = std::make_shared<ReducedProduct>();
+                    state->name = temp_name("iv");
+                    state->increment = increment;
+                    ReducedProductNode* first = new ReducedProductNode(product, side == 0, state);
+                    reduced[key] = first;
+                    products.push_back(first);
+                    *site = first;
+                }
+                return;
+            }
+        }
+    }
+    for (ASTNode** child : node->children()) {
+        reduce_products(child, variable, increment, written, reduced, products);
+    }
+}
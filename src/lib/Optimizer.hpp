@@ -0,0 +1,121 @@
+#ifndef OPTIMIZER_HPP
+#define OPTIMIZER_HPP
+
+#include <set>
+#include <sstream>
+
+#include "STree.hpp"
+
+// Rewrites a parsed STree in place before it is evaluated by scrypt
+class Optimizer {
+    int temp_count = 0;
+
+    // common subexpression elimination
+    struct Subexpression {
+        ASTNode** definition;
+        std::set<std::string> inputs;
+        std::vector<ASTNode**> uses;
+    };
+    std::vector<Subexpression> subexpressions;
+    std::unordered_map<std::string, size_t> available; //printed expression -> index in subexpressions
+    int conditional = 0;    //inside operands that may not be evaluated, which can reuse values but not provide them
+
+    void eliminate_common_subexpressions(STree* tree);
+    void number_expression(ASTNode** site);
+    void kill(const std::string& name);
+    void end_run();
+
+    // inlining
+    struct Binding {
+        std::shared_ptr<value_bd> slot;
+        std::string name;
+        ASTNode* literal = nullptr;     //literal argument, copied into the body instead of stored
+    };
+    typedef std::unordered_map<std::string, Binding> Renaming;
+    int inlined_nodes = 0;
+    void rewrite_calls(STree* tree, std::unordered_map<std::string, FuncNode*> known, const std::multiset<std::string>& writes);
+    SNode* inline_call(SNode* node, FuncNode* func, STree* tree);
+    static void collect_program_writes(STree* tree, std::multiset<std::string>& writes);
+    static bool substitute(ASTNode** site, const Renaming& names);
+    static int count_nodes(ASTNode* node);
+    static int count_nodes(STree* tree);
+
+    // specialization
+    void specialize_call(function_call* call, FuncNode* func);
+    static STree* clone_block(STree* tree);
+    static SNode* clone_statement(SNode* node);
+    static EXP* clone_expression(EXP* expression);
+    static bool substitute_constants(STree* tree, const std::unordered_map<std::string, ASTNode*>& constants);
+    static bool substitute_constants(ASTNode** site, const std::unordered_map<std::string, ASTNode*>& constants);
+
+    // memoization
+    void memoize_functions(STree* tree);
+    static void collect_functions(STree* tree, std::vector<FuncNode*>& functions);
+    static bool is_pure(STree* tree, const std::set<std::string>& locals, std::set<std::string>& assigned, const std::unordered_map<std::string, FuncNode*>& unique, std::set<FuncNode*>& callees);
+    static bool reads_assigned(ASTNode* node, const std::set<std::string>& locals, const std::set<std::string>& assigned);
+
+    // dead code and dead store elimination
+    void eliminate_dead_code(STree* tree);
+    void eliminate_dead_stores(STree* tree);
+    static bool can_splice(STree* branch);
+    static bool cannot_fail(ASTNode* node, const std::set<std::string>& defined);
+    static void collect_reads(ASTNode* node, std::set<std::string>& reads);
+    static int count_statements(SNode* node);
+
+    // loop-invariant code motion and strength reduction
+    void optimize_loops(STree* tree);
+    void optimize_loop(WhileNode* loop);
+    void hoist_invariants(ASTNode** site, const std::set<std::string>& written, WhileNode* loop, std::unordered_map<std::string, InvariantNode*>& hoisted);
+    void eliminate_bounds_checks(WhileNode* loop, const std::multiset<std::string>& writes);
+    bool counted_loop(WhileNode* loop, const std::multiset<std::string>& writes, std::string& counter_name, std::string& bound_name, double& limit_value, bool& inclusive);
+    static void collect_accesses(ASTNode* node, const std::string& variable, std::vector<IndexNode*>& accesses);
+    static int count_element_writes(ASTNode* node, const std::string& name);
+    void reduce_products(ASTNode** site, const std::string& variable, double increment, const std::set<std::string>& written, std::unordered_map<std::string, ReducedProductNode*>& reduced, std::vector<ReducedProductNode*>& products);
+
+    std::string temp_name(const std::string& prefix);
+    static void expression_sites(STree* tree, std::vector<ASTNode**>& sites);
+    static void collect_writes(STree* tree, std::multiset<std::string>& writes, bool& calls);
+    static void collect_writes(ASTNode* node, std::multiset<std::string>& writes, bool definite = false);
+    static bool is_candidate(ASTNode* node);
+    static std::string expression_key(ASTNode* node);
+    static void append_literals(ASTNode* node, std::ostringstream& key);
+    static bool is_pure(ASTNode* node);
+    static void collect_inputs(ASTNode* node, std::set<std::string>& inputs);
+    static std::string assigned_name(AssignmentNode* node);
+
+public:
+    struct Options {
+        bool inline_functions = true;
+        int inline_size = 32;       //largest function body, in expression nodes, that is inlined
+        int inline_growth = 4096;   //nodes all inlined bodies together may add to the program
+        bool specialize = true;
+        int specialize_size = 256;  //largest function body, in expression nodes, that is copied
+        int specializations = 8;    //copies kept per function
+        bool bounds_checks = true; //eliminate bounds checks in counted loops
+        bool infer_types = true;    //evaluate expressions proven to be numbers or bools unboxed
+        bool memoize = true;
+        size_t memo_size = 4096;    //results kept per memoized function
+    };
+    Options options;
+
+    // what the passes did, printed by scrypt --stats
+    struct Stats {
+        int inlined = 0;        //call statements replaced by the body of the function
+        int specialized = 0;    //copies of functions made for literal arguments
+        int constants = 0;      //expressions replaced by the value found by constant propagation
+        int unreachable = 0;    //statements after a return
+        int branches = 0;       //statements in branches that can never run, including the if or while itself
+        int dead_stores = 0;    //assignments overwritten before being read
+        int bounds_checks = 0;  //element accesses covered by a loop's bounds guard
+        int typed = 0;          //expressions seen by type inference
+        int typed_double = 0;   //of those, proven to always be a number
+        int typed_bool = 0;
+        int typed_array = 0;
+        std::vector<MemoTable*> memoized;   //owned by their FuncNode, counters are filled in while running
+    };
+    Stats stats;
+
+    void optimize(STree* tree);
+};
+
+#endif
@@ -1,50 +1,86 @@
 #include "STree.hpp"
 
+#include <algorithm>
+#include <cmath>
+
 //-----------------
 
-SNode::SNode(EXP* exp, SNode* next): expression(exp), next(next) {}
+SNode::SNode(StatementKind kind, EXP* exp, SNode* next): expression(exp), next(next), kind(kind) {}
 SNode::~SNode() {
     delete expression;
     delete next;
 }
+
+// Runs the chain starting at this statement. A return ends the chain it is
+// in and gives its value; the value of a nested block is not used.
 value_bd SNode::evaluate(std::unordered_map<std::string, value_bd>* var_map) {
-    (void)var_map;
+    for (SNode* node = this; node != nullptr; node = node->next) {
+        switch (node->kind) {
+            case StatementKind::Expression:
+                static_cast<ExpressionNode*>(node)->execute(var_map);
+                break;
+            case StatementKind::While:
+                static_cast<WhileNode*>(node)->execute(var_map);
+                break;
+            case StatementKind::For:
+                static_cast<ForNode*>(node)->execute(var_map);
+                break;
+            case StatementKind::Print:
+                static_cast<PrintNode*>(node)->execute(var_map);
+                break;
+            case StatementKind::If:
+                static_cast<IfNode*>(node)->execute(var_map);
+                break;
+            case StatementKind::Def:
+                static_cast<FuncNode*>(node)->execute(var_map);
+                break;
+            case StatementKind::Return:
+                return static_cast<ReturnNode*>(node)->execute(var_map);
+        }
+    }
     value_bd null = value_bd();
     return null;
 }
 
 //-----------------
 
-ExpressionNode::ExpressionNode(EXP* exp, SNode* next): SNode(exp, next) {}
-value_bd ExpressionNode::evaluate(std::unordered_map<std::string, value_bd>* var_map) {
-    if (expression->type == "expression"){
-        expression->expression->evaluate();
-    } else if (expression->type == "function"){
-        expression->function->evaluate(var_map);
-    } else if (expression->type == "function_assigner"){
-        (*var_map)[expression->expression->print_no_endl()] = expression->function->evaluate(var_map);
-    }
-    if (next){
-        return next->evaluate(var_map);
-    } else {
-        value_bd null = value_bd();
-        return null;
+ExpressionNode::ExpressionNode(EXP* exp, SNode* next): SNode(StatementKind::Expression, exp, next) {}
+void ExpressionNode::execute(std::unordered_map<std::string, value_bd>* var_map) {
+    switch (expression->kind) {
+        case ExpKind::Expression:
+            expression->expression->evaluate_statement(var_map);
+            break;
+        case ExpKind::Function:
+            expression->function->evaluate(var_map);
+            break;
+        case ExpKind::FunctionAssigner: {
+            //an element or field is located after the call, like the left side of an assignment
+            IndexNode* element = dynamic_cast<IndexNode*>(expression->expression->head);
+            if (expression->target.empty()) {
+                throw EvaluationError("invalid assignee.");
+            }
+            value_bd result = expression->function->evaluate(var_map);
+            if (element != nullptr) {
+                element->assign(var_map, result);
+            } else {
+                (*var_map)[expression->target] = result;
+            }
+            break;
+        }
     }
 }
 void ExpressionNode::print(int tab) {
     for (int i = 0; i < tab; ++i) {
         std::cout << " ";
     }
-    if (expression->type == "expression"){
+    if (expression->kind == ExpKind::Expression){
         std::cout << expression->expression->print_no_endl();
-    } else if (expression->type == "funciton"){
+    } else if (expression->kind == ExpKind::Function){
         expression->function->print();
-    } else if (expression->type == "function_assigner"){
+    } else if (expression->kind == ExpKind::FunctionAssigner){
         std::cout << "(" << expression->expression->print_no_endl() << " = ";
         expression->function->print();
         std::cout << ")"; 
-    } else {
-        std::cout << "SOMTHING BAD IS HAPPENING \n NOT SUPPOSED TO REACH HERE" << std::endl;
     }
 
     std::cout << ";\n";
@@ -57,28 +93,68 @@ ExpressionNode::~ExpressionNode() {}
 
 //-----------------
 
-WhileNode::WhileNode(EXP* exp, SNode* next, STree* t): SNode(exp, next), trueBranch(t) {}
-value_bd WhileNode::evaluate(std::unordered_map<std::string, value_bd>* var_map) {
-    value_bd exp_eval;
-    while (true){
-        exp_eval = expression->expression->evaluate();
-        if (exp_eval.type_tag != "bool") {
-            throw EvaluationError("condition is not a bool.");
+bool BoundsGuard::holds(std::unordered_map<std::string, value_bd>* var_map) const {
+    auto counter = var_map->find(variable);
+    if (counter == var_map->end() || counter->second.type_tag != "double") {
+        return false;
+    }
+    double end = limit;
+    if (!bound.empty()) {
+        auto found = var_map->find(bound);
+        if (found == var_map->end() || found->second.type_tag != "double") {
+            return false;
         }
-        if (exp_eval.Bool){
-            trueBranch->evaluate();
-        } else {
-            break;
+        end = found->second.Double;
+    }
+    return covers(var_map, counter->second.Double, end);
+}
+
+bool BoundsGuard::covers(std::unordered_map<std::string, value_bd>* var_map, double first, double end) const {
+    auto base = var_map->find(array);
+    if (base == var_map->end() || base->second.type_tag != "array" || std::floor(first) != first) {
+        return false;
+    }
+    //the largest value the counter has inside the loop
+    double last = inclusive ? std::floor(end) : std::ceil(end) - 1;
+    return first + min_offset >= 0 && last + max_offset < base->second.length();
+}
+
+WhileNode::WhileNode(EXP* exp, SNode* next, STree* t): SNode(StatementKind::While, exp, next), trueBranch(t) {}
+WhileNode::WhileNode(StatementKind kind, EXP* exp, SNode* next, STree* t): SNode(kind, exp, next), trueBranch(t) {}
+void WhileNode::reset() {
+    for (InvariantNode* invariant : invariants) {
+        invariant->cache->cached = false;
+    }
+    for (ReducedProductNode* product : products) {
+        product->state->valid = false;
+    }
+}
+void WhileNode::execute(std::unordered_map<std::string, value_bd>* var_map) {
+    reset();
+    for (const BoundsGuard& guard : guards) {
+        guard.check->proven = guard.holds(var_map);
+    }
+    while (expression->expression->evaluate_condition(var_map)) {
+        trueBranch->evaluate(var_map);
+    }
+}
+//hoisted values are only present in optimized trees
+void WhileNode::print_hoisted(int tab) {
+    for (InvariantNode* invariant : invariants) {
+        for (int i = 0; i < tab; ++i) {
+            std::cout << " ";
         }
+        std::cout << "(" << invariant->name << " = " << invariant->expression->print() << ");\n";
     }
-    if (next!= nullptr){ 
-        return next->evaluate(var_map);
-    } else {
-        value_bd null = value_bd();
-        return null;
+    for (ReducedProductNode* product : products) {
+        for (int i = 0; i < tab; ++i) {
+            std::cout << " ";
+        }
+        std::cout << "(" << product->state->name << " = " << product->product->print() << ");\n";
     }
 }
 void WhileNode::print(int tab) {
+    print_hoisted(tab);
     for (int i = 0; i < tab; ++i) {
         std::cout << " ";
     }
@@ -99,12 +175,91 @@ WhileNode::~WhileNode() {
 
 //-----------------
 
-PrintNode::PrintNode(EXP* exp, SNode* next): SNode(exp, next) {}
-value_bd PrintNode::evaluate(std::unordered_map<std::string, value_bd>* var_map) {
+ForNode::ForNode(std::string variable, EXP* exp, SNode* next, STree* t): WhileNode(StatementKind::For, exp, next, t), variable(variable) {}
+
+// The variable's entry is looked up once; it is looked up again when
+// FuncNode::version changes
+void ForNode::execute(std::unordered_map<std::string, value_bd>* var_map) {
+    reset();
+    ASTNode* head = expression->expression->head;
+    if (RangeNode* range = dynamic_cast<RangeNode*>(head)) {
+        double first = 0;
+        double end = 0;
+        if (range->from->proven == ProvenType::Double && range->to->proven == ProvenType::Double) {
+            first = range->from->evaluate_double(var_map);
+            end = range->to->evaluate_double(var_map);
+        } else {
+            value_bd from = range->from->evaluate(var_map);
+            value_bd to = range->to->evaluate(var_map);
+            if (from.type_tag != "double" || to.type_tag != "double") {
+                throw EvaluationError("range bounds are not numbers.");
+            }
+            first = from.Double;
+            end = to.Double;
+        }
+        for (const BoundsGuard& guard : guards) {
+            guard.check->proven = guard.covers(var_map, first, end);
+        }
+        unsigned long version = FuncNode::version;
+        value_bd* slot = &(*var_map)[variable];
+        for (double counter = first; counter < end; counter += 1) {
+            if (version != FuncNode::version) {
+                version = FuncNode::version;
+                slot = &(*var_map)[variable];
+            }
+            if (slot->type_tag == "double") {
+                slot->Double = counter;
+            } else {
+                *slot = value_bd("double", counter);
+            }
+            trueBranch->evaluate(var_map);
+        }
+        return;
+    }
+    value_bd items = head->evaluate(var_map);
+    if (items.type_tag != "array") {
+        throw EvaluationError("for can only iterate over a range or an array.");
+    }
+    bool numbers = items.packed != nullptr && !items.packed->flags_only;
+    unsigned long version = FuncNode::version;
+    value_bd* slot = &(*var_map)[variable];
+    for (size_t i = 0; i < items.length(); i++) {
+        if (version != FuncNode::version) {
+            version = FuncNode::version;
+            slot = &(*var_map)[variable];
+        }
+        if (numbers && slot->type_tag == "double") {
+            slot->Double = items.number_at(i);
+        } else {
+            *slot = items.at(i);
+        }
+        trueBranch->evaluate(var_map);
+    }
+}
+void ForNode::print(int tab) {
+    print_hoisted(tab);
+    for (int i = 0; i < tab; ++i) {
+        std::cout << " ";
+    }
+    std::cout << "for " << variable << " in " << expression->expression->print_no_endl() << " {" << std::endl;
+    trueBranch->print(tab + 4);
+    for (int i = 0; i < tab; ++i) {
+        std::cout << " ";
+    }
+    std::cout << "}" << std::endl;
+    if(next != nullptr) {
+        next->print(tab);
+    }
+}
+
+//-----------------
+
+PrintNode::PrintNode(EXP* exp, SNode* next): SNode(StatementKind::Print, exp, next) {}
+void PrintNode::execute(std::unordered_map<std::string, value_bd>* var_map) {
     value_bd ans;
-    if (expression->type == "expression"){
-        ans = expression->expression->evaluate();
-    } else if (expression->type == "function"){
+    if (expression->kind == ExpKind::Expression){
+        ans = expression->expression->evaluate(var_map);
+    } else if (expression->kind == ExpKind::Function){
         ans = expression->function->evaluate(var_map);
     }
 
@@ -119,20 +274,13 @@ value_bd PrintNode::evaluate(std::unordered_map<std::string, value_bd>* var_map)
     } else {
         std::cout << ans.Double << std::endl;
     }
-
-    if(next){
-        return next->evaluate(var_map);
-    } else {
-        value_bd null = value_bd();
-        return null;
-    }
 }
 void PrintNode::print(int tab) {
     for (int i = 0; i < tab; ++i) {
         std::cout << " ";
     }
     std::cout << "print ";
-    if(expression->type == "expression"){
+    if(expression->kind == ExpKind::Expression){
         std::cout << expression->expression->print_no_endl();
     } else{
         expression->function->print();
@@ -146,26 +294,85 @@ PrintNode::~PrintNode() {}
 
 //-----------------
 
-IfNode::IfNode(EXP* exp, SNode* next, STree* t, STree* f): SNode(exp, next), trueBranch(t), falseBranch(f) {}
-value_bd IfNode::evaluate(std::unordered_map<std::string, value_bd>* var_map) {
-    value_bd exp_eval = expression->expression->evaluate();
-    if (exp_eval.type_tag != "bool") {
-        throw EvaluationError("condition is not a bool.");
+IfNode::IfNode(EXP* exp, SNode* next, STree* t, STree* f): SNode(StatementKind::If, exp, next), trueBranch(t), falseBranch(f) {}
+void IfNode::execute(std::unordered_map<std::string, value_bd>* var_map) {
+    if (!flattened) {
+        flatten();
     }
-    if (exp_eval.Bool){
-        trueBranch->evaluate();
-    } else {
-        if (falseBranch!=nullptr) {
-            falseBranch->evaluate();
+    if (selector != nullptr) {
+        value_bd value = selector->evaluate(var_map);
+        STree* taken = otherwise;
+        if (value.type_tag == "double") {
+            double key = value.Double == 0.0 ? 0.0 : value.Double;
+            auto found = std::lower_bound(cases.begin(), cases.end(), std::make_pair(key, size_t(0)));
+            if (found != cases.end() && found->first == key) {
+                taken = arms[found->second].second;
+            }
+        }
+        if (taken != nullptr) {
+            taken->evaluate(var_map);
         }
+        return;
     }
-    if (next){
-        return next->evaluate(var_map);
-    } else {
-        value_bd null = value_bd();
-        return null;
+    for (auto& arm : arms) {
+        if (arm.first->evaluate_condition(var_map)) {
+            arm.second->evaluate(var_map);
+            return;
+        }
+    }
+    if (otherwise != nullptr) {
+        otherwise->evaluate(var_map);
     }
 }
+
+// Collects the conditions and blocks of an else-if chain, which the parser
+// nests as an else block holding nothing but the next if. When every
+// condition is `x == number` (or `number == x`) on the same variable, the
+// chain becomes a binary search on the value of x: a value that is not a
+// number equals none of them, and the first of two equal numbers wins.
+void IfNode::flatten(){
+    flattened = true;
+    IfNode* node = this;
+    while (true) {
+        arms.push_back({node->expression->expression, node->trueBranch});
+        STree* rest = node->falseBranch;
+        if (rest == nullptr || rest->head == nullptr || rest->head->next != nullptr || rest->head->kind != StatementKind::If) {
+            otherwise = rest;
+            break;
+        }
+        node = static_cast<IfNode*>(rest->head);
+    }
+    if (arms.size() < 3) {
+        return;
+    }
+    IdentifierNode* variable = nullptr;
+    for (size_t i = 0; i < arms.size(); i++) {
+        EqualNode* equal = dynamic_cast<EqualNode*>(arms[i].first->head);
+        if (equal == nullptr) {
+            return;
+        }
+        IdentifierNode* id = dynamic_cast<IdentifierNode*>(equal->left);
+        NumberNode* number = dynamic_cast<NumberNode*>(equal->right);
+        if (id == nullptr || number == nullptr) {
+            id = dynamic_cast<IdentifierNode*>(equal->right);
+            number = dynamic_cast<NumberNode*>(equal->left);
+        }
+        if (id == nullptr || number == nullptr || id->name == "null" || (variable != nullptr && id->name != variable->name)) {
+            return;
+        }
+        variable = id;
+        double key = number->value.Double == 0.0 ? 0.0 : number->value.Double;
+        bool seen = false;
+        for (auto& entry : cases) {
+            seen = seen || entry.first == key;
+        }
+        if (!seen) {
+            cases.push_back({key, i});
+        }
+    }
+    std::sort(cases.begin(), cases.end());
+    selector = variable;
+}
 void IfNode::print(int tab) {
     for (int i = 0; i < tab; ++i) {
         std::cout << " ";
@@ -206,22 +413,21 @@ IfNode::~IfNode() {
 //-----------------
 
 FuncNode::FuncNode(SNode* next, STree* code, std::vector<std::string> p, std::string name): 
-    SNode(nullptr, next),
+    SNode(StatementKind::Def, nullptr, next),
     f_name(name),
     parameters(p),
     code(code) {}
-value_bd FuncNode::evaluate(std::unordered_map<std::string, value_bd>* var_map) {
+unsigned long FuncNode::version = 1;
+unsigned long FuncNode::definitions = 0;
+
+void FuncNode::execute(std::unordered_map<std::string, value_bd>* var_map) {
     (*var_map)[f_name] = value_bd(this);
 
     if (code){
         code->var_map = new std::unordered_map<std::string, value_bd>(*var_map);
     }
-    if(next){
-        return next->evaluate(var_map);
-    } else {
-        value_bd null = value_bd();
-        return null;
-    }
+    ++version;
+    ++definitions;
 }
 void FuncNode::print(int tab) {
     for (int i = 0; i < tab; ++i) {
@@ -247,6 +453,9 @@ void FuncNode::print(int tab) {
         std::cout << " ";
     }
     std::cout << "}" << std::endl;
+    for (auto& entry : specializations) {
+        entry.second->print(tab);
+    }
     if(next != nullptr) {
         next->print(tab);
     }
@@ -255,17 +464,254 @@ FuncNode::~FuncNode() {
     delete code;
 }
 
+static void collect_locals(ASTNode* node, std::set<std::string>& names){
+    if (AssignmentNode* assignment = dynamic_cast<AssignmentNode*>(node)) {
+        if (IdentifierNode* id = dynamic_cast<IdentifierNode*>(assignment->id)) {
+            names.insert(id->name);
+        } else if (IndexNode* element = dynamic_cast<IndexNode*>(assignment->id)) {
+            names.insert(element->name);
+        }
+    }
+    for (ASTNode** child : node->children()) {
+        collect_locals(*child, names);
+    }
+}
+
+void FuncNode::collect_locals(STree* tree, std::set<std::string>& names){
+    if (tree == nullptr) {
+        return;
+    }
+    for (SNode* node = tree->head; node != nullptr; node = node->next) {
+        if (ForNode* each = dynamic_cast<ForNode*>(node)) {
+            names.insert(each->variable);
+        }
+        if (WhileNode* loop = dynamic_cast<WhileNode*>(node)) {
+            collect_locals(loop->trueBranch, names);
+        } else if (IfNode* branch = dynamic_cast<IfNode*>(node)) {
+            collect_locals(branch->trueBranch, names);
+            collect_locals(branch->falseBranch, names);
+        } else if (FuncNode* func = dynamic_cast<FuncNode*>(node)) {
+            names.insert(func->f_name);
+        }
+        if (node->expression != nullptr && node->expression->expression != nullptr) {
+            if (node->expression->kind == ExpKind::FunctionAssigner) {
+                names.insert(node->expression->target);
+            } else {
+                ::collect_locals(node->expression->expression->head, names);
+            }
+        }
+        if (node->expression != nullptr && node->expression->function != nullptr && !node->expression->function->mutated().empty()) {
+            names.insert(node->expression->function->mutated());
+        }
+    }
+}
+
+// A memoized function may return a result computed for the same arguments
+// before. Any def that runs can change what a function sees in its map, so
+// the table is emptied whenever that happens.
+value_bd FuncNode::call(const std::vector<value_bd*>& slots, std::vector<value_bd>& arguments){
+    MemoTable::Key key;
+    if (memo == nullptr || !MemoTable::make_key(arguments, key)) {
+        return invoke(slots, arguments);
+    }
+    if (memo->generation != definitions) {
+        memo->clear();
+        memo->generation = definitions;
+    }
+    if (const value_bd* found = memo->find(key)) {
+        return *found;
+    }
+    value_bd result = invoke(slots, arguments);
+    memo->insert(key, result);
+    return result;
+}
+
+// All activations of a function share its map. The arguments go straight into
+// the parameter entries cached by the call site; only a recursive call has to
+// save the variables of the activation below it and put them back afterwards.
+// A specialized copy runs in the map of the function it was made from and
+// shares its recursion state, since both write the same variables.
+value_bd FuncNode::invoke(const std::vector<value_bd*>& slots, std::vector<value_bd>& arguments){
+    FuncNode* base = origin != nullptr ? origin : this;
+    std::unordered_map<std::string, value_bd>* var_map = base->code->var_map;
+    int& active = base->active;
+    std::vector<std::pair<value_bd*, value_bd>> saved;
+    std::vector<std::string> absent;
+    if (active > 0) {
+        if (!base->locals_known) {
+            std::set<std::string> names(base->parameters.begin(), base->parameters.end());
+            collect_locals(base->code, names);
+            base->locals.assign(names.begin(), names.end());
+            base->locals_known = true;
+        }
+        for (const std::string& name : base->locals) {
+            auto found = var_map->find(name);
+            if (found == var_map->end()) {
+                absent.push_back(name);
+            } else {
+                saved.push_back({&found->second, found->second});
+            }
+        }
+    }
+    for (size_t i = 0; i < slots.size(); i++) {
+        *slots[i] = std::move(arguments[i]);
+    }
+    active++;
+    value_bd result = code->evaluate(var_map);
+    active--;
+    for (auto& entry : saved) {
+        *entry.first = std::move(entry.second);
+    }
+    //the only erased entry a call site can still point at is a function it
+    //calls; parameters are in the map before the first call and a loop sets
+    //its variable before its body can recurse, so the version is left alone
+    //for the locals a recursive call assigned first
+    for (const std::string& name : absent) {
+        auto found = var_map->find(name);
+        if (found == var_map->end()) {
+            continue;
+        }
+        bool function = found->second.type_tag == "function";
+        var_map->erase(found);
+        if (function) {
+            ++version;
+        }
+    }
+    return result;
+}
+
 //-----------------
 
-ReturnNode::ReturnNode(EXP* exp, SNode* next): SNode(exp,next){}
-value_bd ReturnNode::evaluate(std::unordered_map<std::string, value_bd>* var_map){
-    if (!expression || expression->expression->print_no_endl() == "null"){
+// The callee and the entries of its parameters are looked up once and reused
+// until a function is bound again, which is the only time the map of a
+// function is replaced. Rebinding the name to another value is caught by
+// comparing the function the name holds now with the cached one.
+value_bd function_call::evaluate(std::unordered_map<std::string, value_bd>* var_map){
+    if (builtin != nullptr && cached_map == var_map && var_map->count(name) == 0) {
+        return call_builtin(var_map);
+    }
+    if (builtin != nullptr || cached_version != FuncNode::version || cached_map != var_map || callee->Function_Node != cached_func) {
+        resolve(var_map);
+        if (builtin != nullptr) {
+            return call_builtin(var_map);
+        }
+    }
+    if (cached_func == expected) {
+        for (size_t i = 0; i < kept.size(); i++) {
+            specialized_values[i] = arguments[kept[i]]->evaluate(var_map);
+        }
+        return specialized->call(specialized_slots, specialized_values);
+    }
+    for (size_t i = 0; i < arguments.size(); i++) {
+        values[i] = arguments[i]->evaluate(var_map);
+    }
+    if (cached_func->code == nullptr) {
+        value_bd null = value_bd();
+        return null;
+    }
+    return cached_func->call(slots, values);
+}
+
+void function_call::resolve(std::unordered_map<std::string, value_bd>* var_map){
+    cached_version = 0;
+    builtin = nullptr;
+    auto found = var_map->find(name);
+    if(found == var_map->end()){
+        builtin = find_builtin(name);
+        if (builtin == nullptr) {
+            throw EvaluationError("function not found");
+        }
+        if (builtin->arity != arguments.size()) {
+            builtin = nullptr;
+            throw EvaluationError("param size doesnt match");
+        }
+        named.clear();
+        for (ASTree* argument : arguments) {
+            IdentifierNode* variable = dynamic_cast<IdentifierNode*>(argument->head);
+            named.push_back(variable != nullptr && variable->name != "null" ? variable->name : "");
+        }
+        values.resize(arguments.size());
+        pointers.resize(arguments.size());
+        cached_map = var_map;
+        return;
+    }
+    if (found->second.type_tag != "function"){
+        throw EvaluationError("not a function");
+    }
+    FuncNode* myfunc = found->second.Function_Node;
+    if(myfunc->parameters.size() != arguments.size()){
+        throw EvaluationError("param size doesnt match");
+    }
+    slots.clear();
+    if (myfunc->code) {
+        for (const std::string& parameter : myfunc->parameters) {
+            slots.push_back(&(*myfunc->code->var_map)[parameter]);
+        }
+    }
+    values.resize(arguments.size());
+    if (myfunc == expected) {
+        specialized_slots.clear();
+        for (const std::string& parameter : specialized->parameters) {
+            specialized_slots.push_back(&(*myfunc->code->var_map)[parameter]);
+        }
+        specialized_values.resize(kept.size());
+    }
+    callee = &found->second;
+    cached_func = myfunc;
+    cached_map = var_map;
+    cached_version = FuncNode::version;
+}
+
+// Variables are passed by their entries in the map, looked up after every
+// other argument is evaluated since an assignment there can rehash it. The
+// evaluated arguments are dropped afterwards so that they do not keep a
+// share of an array that is written next.
+value_bd function_call::call_builtin(std::unordered_map<std::string, value_bd>* var_map){
+    for (size_t i = 0; i < arguments.size(); i++) {
+        if (named[i].empty()) {
+            values[i] = arguments[i]->evaluate(var_map);
+            pointers[i] = &values[i];
+        }
+    }
+    for (size_t i = 0; i < arguments.size(); i++) {
+        if (!named[i].empty()) {
+            auto found = var_map->find(named[i]);
+            if (found == var_map->end()) {
+                values[i] = arguments[i]->evaluate(var_map);
+                pointers[i] = &values[i];
+            } else {
+                pointers[i] = &found->second;
+            }
+        }
+    }
+    value_bd result = builtin->run(pointers.data());
+    for (value_bd& value : values) {
+        value = value_bd();
+    }
+    return result;
+}
+
+std::string function_call::mutated() const{
+    const Builtin* callee = find_builtin(name);
+    if (callee == nullptr || !callee->mutates || arguments.empty()) {
+        return "";
+    }
+    IdentifierNode* variable = dynamic_cast<IdentifierNode*>(arguments[0]->head);
+    return variable != nullptr && variable->name != "null" ? variable->name : "";
+}
+
+//-----------------
+
+ReturnNode::ReturnNode(EXP* exp, SNode* next): SNode(StatementKind::Return, exp, next){
+    returns_null = !exp || exp->expression->print_no_endl() == "null";
+}
+value_bd ReturnNode::execute(std::unordered_map<std::string, value_bd>* var_map){
+    if (returns_null){
         value_bd null = value_bd();
         return null;
     } else {
-        return expression->expression->evaluate();
+        return expression->expression->evaluate(var_map);
     }
-    (void)var_map;
     //does not call next, as we dont need to evaluate after return.
     }
 void ReturnNode::print(int tab){
@@ -296,7 +742,15 @@ STree::STree(std::vector<token> tokens, std::unordered_map<std::string, value_bd
     }
 }
 
+STree::STree(SNode* head, std::unordered_map<std::string, value_bd>* var_map): head(head), var_map(var_map) {}
+
 value_bd STree::evaluate(){
+    return evaluate(var_map);
+}
+
+// Blocks run with the variables of the code they are part of, which for a
+// function body is the map of the function and not the one it was parsed with
+value_bd STree::evaluate(std::unordered_map<std::string, value_bd>* var_map){
     if (head) {
         return head->evaluate(var_map);
     } else {
@@ -468,6 +922,96 @@ SNode* STree::parse_block() {
 
 
 
+    //FOR STATEMENT
+    else if(get_current_token().type == TokenType::VARIABLES && get_current_token().text == "for" && block[current_token_index+1].type == TokenType::VARIABLES && block[current_token_index+2].text == "in") {
+        EXP* exp = nullptr;
+        STree* run = nullptr;
+        int temp_row = get_current_token().row;
+        int temp_col = get_current_token().col;
+        consume_token(); //consume for
+        std::string name = get_current_token().text;
+        consume_token(); consume_token(); //consume the variable and in
+        std::vector<token> from_tokens;
+        std::vector<token> to_tokens;
+        bool range = false;
+        int range_row = 0;
+        int range_col = 0;
+        int depth = 0;  //a .. inside brackets or a call belongs to an operand
+        while (get_current_token().type != TokenType::L_CURLY) {
+            if(get_current_token().type == TokenType::END) {
+                throw ParseError(get_current_token().row, get_current_token().col, get_current_token());
+            }
+            if (get_current_token().type == TokenType::LEFT_PAREN || get_current_token().type == TokenType::L_SQUARE) {
+                depth++;
+            } else if (get_current_token().type == TokenType::RIGHT_PAREN || get_current_token().type == TokenType::R_SQUARE) {
+                depth--;
+            }
+            temp_row = get_current_token().row;
+            temp_col = get_current_token().col;
+            if (get_current_token().type == TokenType::RANGE && depth == 0 && !range) {
+                range = true;
+                range_row = get_current_token().row;
+                range_col = get_current_token().col;
+            } else if (range) {
+                to_tokens.push_back(get_current_token());
+            } else {
+                from_tokens.push_back(get_current_token());
+            }
+            consume_token();
+        }
+        token end_token{temp_row,temp_col+1,"END",TokenType::END};
+        from_tokens.push_back(end_token);
+        if (range) {
+            //the bounds are parsed on their own and moved under one range node
+            to_tokens.push_back(end_token);
+            ASTree* from = new ASTree(from_tokens, var_map);
+            ASTree* to = nullptr;
+            try {
+                to = new ASTree(to_tokens, var_map);
+            } catch (const ParseError& e) {
+                delete from;
+                throw e;
+            }
+            RangeNode* bounds = new RangeNode(range_row, range_col, from->head, to->head);
+            from->head = nullptr;
+            to->head = nullptr;
+            delete from;
+            delete to;
+            exp = new EXP(new ASTree(bounds, var_map));
+        } else {
+            exp = new EXP(new ASTree(from_tokens, var_map));
+        }
+        consume_token(); //consume left curly
+        std::vector<token> block_tokens;
+        int open_braces = 0; //keep track of curly braces
+        while (open_braces>=0){
+            if(get_current_token().type == TokenType::END) {
+                delete exp;
+                throw ParseError(get_current_token().row, get_current_token().col, get_current_token());
+            }
+            if (get_current_token().type == TokenType::L_CURLY){
+                open_braces++;
+            } else if (get_current_token().type == TokenType::R_CURLY){
+                open_braces--;
+            }
+            if (open_braces>=0){
+                block_tokens.push_back(get_current_token());
+                consume_token();
+            }
+        }
+        block_tokens.push_back(end_token);
+        try {
+            run = new STree(block_tokens, var_map);
+        } catch (const ParseError& e) {
+            delete exp;
+            throw e;
+        }
+        consume_token(); //consume closing right curly
+        return new ForNode(name, exp, parse_block(), run);
+    }
+
+
+
     //WHILE STATEMENT
     else if(get_current_token().type == TokenType::STATEMENT && get_current_token().text == "while") {
         EXP* exp = nullptr;
@@ -528,13 +1072,22 @@ SNode* STree::parse_block() {
         int temp_col = get_current_token().col;
         bool semi_colon = false;
         consume_token(); //consume print
-        if(get_current_token().type == TokenType::VARIABLES && block[current_token_index+1].type == TokenType::LEFT_PAREN) { //function
+        if(get_current_token().type == TokenType::VARIABLES && block[current_token_index+1].type == TokenType::LEFT_PAREN && RecordLayout::find(get_current_token().text) == nullptr) { //function
             std::vector<ASTree*> arg;
             std::string name = get_current_token().text;
             consume_token(); consume_token(); //consume func_name and left paren
             std::vector<token> expression_tokens;
-            while (get_current_token().type != TokenType::RIGHT_PAREN) {
-                if (get_current_token().type == TokenType::COMMA){
+            int depth = 0;  //parentheses, brackets and braces opened inside the arguments
+            while (depth > 0 || get_current_token().type != TokenType::RIGHT_PAREN) {
+                if (get_current_token().type == TokenType::END) {
+                    throw ParseError(get_current_token().row, get_current_token().col, get_current_token());
+                }
+                if (get_current_token().type == TokenType::LEFT_PAREN || get_current_token().type == TokenType::L_SQUARE || get_current_token().type == TokenType::L_CURLY) {
+                    depth++;
+                } else if (get_current_token().type == TokenType::RIGHT_PAREN || get_current_token().type == TokenType::R_SQUARE || get_current_token().type == TokenType::R_CURLY) {
+                    depth--;
+                }
+                if (get_current_token().type == TokenType::COMMA && depth == 0){
                     if (expression_tokens.size()==0){
                         throw ParseError(get_current_token().row, get_current_token().col, get_current_token());
                     }
@@ -590,6 +1143,41 @@ SNode* STree::parse_block() {
     
 
 
+    //RECORD DECLARATION
+    //the layout is made now, so the statements after it can construct records
+    else if (get_current_token().text == "record" && block[current_token_index+1].type == TokenType::VARIABLES && block[current_token_index+2].type == TokenType::LEFT_PAREN) {
+        int temp_row = get_current_token().row;
+        int temp_col = get_current_token().col;
+        consume_token(); //consume record
+        std::string record_name = get_current_token().text;
+        consume_token(); //consume name
+        consume_token(); //consume (
+        std::vector<std::string> fields;
+        while (get_current_token().type != TokenType::RIGHT_PAREN) {
+            if (!fields.empty()) {
+                if (get_current_token().type != TokenType::COMMA) {
+                    throw ParseError(get_current_token().row, get_current_token().col, get_current_token());
+                }
+                consume_token();
+            }
+            if (get_current_token().type != TokenType::VARIABLES || std::find(fields.begin(), fields.end(), get_current_token().text) != fields.end()) {
+                throw ParseError(get_current_token().row, get_current_token().col, get_current_token());
+            }
+            fields.push_back(get_current_token().text);
+            consume_token();
+        }
+        consume_token(); //consume )
+        if (get_current_token().type != TokenType::SEMI_COLON) {
+            throw ParseError(get_current_token().row, get_current_token().col, get_current_token());
+        }
+        consume_token(); //consume ;
+        const RecordLayout* layout = RecordLayout::declare(record_name, fields);
+        EXP* exp = new EXP(new ASTree(new RecordDeclNode(temp_row, temp_col, layout), var_map));
+        return new ExpressionNode(exp, parse_block());
+    }
+
+
+
     //FUNCTION STATEMENT
     else if(get_current_token().text == "def" && block[current_token_index+1].text != "=") { //def is a keyword
         STree* code = nullptr;
@@ -702,13 +1290,22 @@ SNode* STree::parse_block() {
                 break;
             }
 
-            if(get_current_token().type == TokenType::VARIABLES && block[current_token_index+1].type == TokenType::LEFT_PAREN) { //function
+            if(get_current_token().type == TokenType::VARIABLES && block[current_token_index+1].type == TokenType::LEFT_PAREN && RecordLayout::find(get_current_token().text) == nullptr) { //function
                 std::vector<ASTree*> arg;
                 std::string name = get_current_token().text;
                 consume_token(); consume_token(); //consume func_name and left paren
                 std::vector<token> expression_tokens;
-                while (get_current_token().type != TokenType::RIGHT_PAREN) {
-                    if (get_current_token().type == TokenType::COMMA){
+                int depth = 0;  //parentheses, brackets and braces opened inside the arguments
+                while (depth > 0 || get_current_token().type != TokenType::RIGHT_PAREN) {
+                    if (get_current_token().type == TokenType::END) {
+                        throw ParseError(get_current_token().row, get_current_token().col, get_current_token());
+                    }
+                    if (get_current_token().type == TokenType::LEFT_PAREN || get_current_token().type == TokenType::L_SQUARE || get_current_token().type == TokenType::L_CURLY) {
+                        depth++;
+                    } else if (get_current_token().type == TokenType::RIGHT_PAREN || get_current_token().type == TokenType::R_SQUARE || get_current_token().type == TokenType::R_CURLY) {
+                        depth--;
+                    }
+                    if (get_current_token().type == TokenType::COMMA && depth == 0){
                         if (expression_tokens.size()==0){
                             throw ParseError(get_current_token().row, get_current_token().col, get_current_token());
                         }
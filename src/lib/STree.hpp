@@ -1,92 +1,177 @@
 #ifndef STREE_HPP
 #define STREE_HPP
 
+#include <map>
+#include <set>
+
 #include "ASTree.hpp"
+#include "Memo.hpp"
+#include "Builtins.hpp"
 //#include "function_support.hpp"
 
 class STree;
 class FuncNode; 
 class EXP;
 
+// Kept in every statement so a chain is run by one loop switching on it,
+// without a virtual call or a string compare per statement
+enum class StatementKind : unsigned char { Expression, While, For, Print, If, Def, Return };
+
 class SNode {
+    friend class Optimizer;
+    friend class IRProgram;
+    friend class FuncNode;
+    friend class IfNode;
 protected:
     EXP* expression;
     SNode* next;
 
 public:
-    virtual std::string type() { return "Snode";} //used in print to determine the type of the node
-    SNode(EXP* exp, SNode* next);
+    const StatementKind kind;
+    SNode(StatementKind kind, EXP* exp, SNode* next);
     virtual ~SNode();
-    virtual value_bd evaluate(std::unordered_map<std::string, value_bd>* var_map);
+    value_bd evaluate(std::unordered_map<std::string, value_bd>* var_map); //runs this statement and the ones after it
     virtual void print(int tab) {(void)tab;}
 };
 
 class ExpressionNode : public SNode {
 public:
-    std::string type() {return "exp";}
     explicit ExpressionNode(EXP* exp, SNode* next);
     ~ExpressionNode();
-    value_bd evaluate(std::unordered_map<std::string, value_bd>* var_map);
+    void execute(std::unordered_map<std::string, value_bd>* var_map);
     void print(int tab);
 };
 
+// Entry test of a loop counting `variable` up by a positive integer step while
+// it is below (or at most) the bound, where the covered accesses index `array`
+// with the variable plus offsets in [min_offset, max_offset]. Nothing in the
+// loop can change the array's length, the bound or the step, so the test
+// holding on entry means it holds on every iteration. A for loop over a range
+// knows its first and end values itself and tests them with covers.
+struct BoundsGuard {
+    std::string array;
+    std::string variable;
+    std::string bound;          //variable holding the bound, empty for a literal
+    double limit = 0;           //the literal bound
+    bool inclusive = false;     //the condition is <= rather than <
+    double min_offset = 0;
+    double max_offset = 0;
+    std::shared_ptr<BoundsCheck> check;
+    bool holds(std::unordered_map<std::string, value_bd>* var_map) const;
+    bool covers(std::unordered_map<std::string, value_bd>* var_map, double first, double end) const;
+};
+
 class WhileNode : public SNode {
+    friend class Optimizer;
+    friend class IRProgram;
+    friend class FuncNode;
 protected:
     STree* trueBranch;
+    std::vector<InvariantNode*> invariants;     //owned by the trees they were hoisted from
+    std::vector<ReducedProductNode*> products;
+    std::vector<BoundsGuard> guards;
+    WhileNode(StatementKind kind, EXP* exp, SNode* next, STree* t);
+    void reset();               //forgets the hoisted values of the last time the loop ran
+    void print_hoisted(int tab);
 public:
-    std::string type() {return "while";}
     explicit WhileNode(EXP* exp, SNode* next, STree* t);
     ~WhileNode();
-    value_bd evaluate(std::unordered_map<std::string, value_bd>* var_map);
+    void execute(std::unordered_map<std::string, value_bd>* var_map);
+    void print(int tab);
+};
+
+// for i in a..b { } runs the block with i = a, a + 1, ... up to but not
+// including b, both evaluated once before the first iteration. for x in e { }
+// runs it with x set to each element of the array e, evaluated once too.
+// The loop keeps its own position in a plain counter and stores it into the
+// variable's entry before each iteration, so assigning the variable in the
+// block does not change what comes next. The expression of the statement is
+// the RangeNode or the array; the optimizer treats the loop as a while loop
+// that assigns the variable once per iteration.
+class ForNode : public WhileNode {
+    friend class Optimizer;
+    friend class IRProgram;
+    friend class FuncNode;
+protected:
+    std::string variable;
+public:
+    ForNode(std::string variable, EXP* exp, SNode* next, STree* t);
+    void execute(std::unordered_map<std::string, value_bd>* var_map);
     void print(int tab);
 };
 
 class PrintNode : public SNode {
 public:
-    std::string type() {return "print";}
     explicit PrintNode(EXP* exp, SNode* next);
     ~PrintNode();
-    value_bd evaluate(std::unordered_map<std::string, value_bd>* var_map);
+    void execute(std::unordered_map<std::string, value_bd>* var_map);
     void print(int tab);
 };
 
 class IfNode : public SNode {
+    friend class Optimizer;
+    friend class IRProgram;
+    friend class FuncNode;
 protected:
     STree* trueBranch;
     STree* falseBranch;
+
+    // An else-if chain is kept nested for the optimizer and run as one ladder
+    // of conditions and blocks from its first if, see IfNode::flatten
+    bool flattened = false;
+    std::vector<std::pair<ASTree*, STree*>> arms;
+    STree* otherwise = nullptr;
+    IdentifierNode* selector = nullptr;             //variable every condition compares to a number
+    std::vector<std::pair<double, size_t>> cases;   //sorted numbers and the arm they select
+    void flatten();
 public:
-    std::string type() {return "if";}
     explicit IfNode(EXP* exp, SNode* next, STree* t, STree* f);
     ~IfNode();
-    value_bd evaluate(std::unordered_map<std::string, value_bd>* var_map);
+    void execute(std::unordered_map<std::string, value_bd>* var_map);
     void print(int tab);
 };
 
 class FuncNode : public SNode {
+    friend class Optimizer;
+    friend class IRProgram;
 protected:
     std::string f_name;
+    int active = 0;                     //calls in progress, more than one when recursing
+    bool locals_known = false;
+    std::vector<std::string> locals;    //parameters and assigned variables, saved around recursive calls
+    static void collect_locals(STree* tree, std::set<std::string>& names);
+    value_bd invoke(const std::vector<value_bd*>& slots, std::vector<value_bd>& arguments);
 public:
+    static unsigned long version;       //changes whenever a function map is replaced
+    static unsigned long definitions;   //changes whenever a def runs
+    std::unique_ptr<MemoTable> memo;    //set by the optimizer for pure recursive functions
+    FuncNode* origin = nullptr;         //function a specialized copy was made from
+    std::map<std::string, std::unique_ptr<FuncNode>> specializations; //copies keyed by the literal arguments
     std::vector<std::string> parameters;
     STree* code;
-    std::string type() {return "def";}
     explicit FuncNode(SNode* next, STree* code, std::vector<std::string> p, std::string name);
     ~FuncNode();
-    value_bd evaluate(std::unordered_map<std::string, value_bd>* var_map);
+    void execute(std::unordered_map<std::string, value_bd>* var_map);
+    value_bd call(const std::vector<value_bd*>& slots, std::vector<value_bd>& arguments);
     void print(int tab);
     //void call(std::vector<token> arguments);
 };
 
 class ReturnNode : public SNode {
+    bool returns_null;
 public:
-    std::string type() {return "return";}
     explicit ReturnNode(EXP* exp, SNode* next);
     ~ReturnNode();
-    value_bd evaluate(std::unordered_map<std::string, value_bd>* var_map);
+    value_bd execute(std::unordered_map<std::string, value_bd>* var_map);
     // value_bd call(std::unordered_map<std::string, value_bd>* var_map);
     void print(int tab);
 };
 
 class STree {
+    friend class Optimizer;
+    friend class IRProgram;
+    friend class FuncNode;
+    friend class IfNode;
     SNode* head = nullptr;
     std::vector<token> block;
     size_t current_token_index = 0;
@@ -100,8 +185,10 @@ public:
     std::unordered_map<std::string, value_bd>* var_map;
 
     STree(std::vector<token> tokens, std::unordered_map<std::string, value_bd>* var_map);
+    STree(SNode* head, std::unordered_map<std::string, value_bd>* var_map); //for blocks built by the optimizer
     SNode* get_head();
     value_bd evaluate();
+    value_bd evaluate(std::unordered_map<std::string, value_bd>* var_map);
     void print(int tab);
     ~STree();
 
@@ -117,6 +204,32 @@ public:
 struct function_call{
     std::string name;
     std::vector<ASTree*> arguments;
+
+    // inline cache of the resolved callee, see function_call::evaluate
+    unsigned long cached_version = 0;
+    std::unordered_map<std::string, value_bd>* cached_map = nullptr;
+    value_bd* callee = nullptr;
+    FuncNode* cached_func = nullptr;
+    std::vector<value_bd*> slots;   //parameter entries in the callee's map
+    std::vector<value_bd> values;   //evaluated arguments
+
+    // specialized copy of the callee made by the optimizer for literal arguments,
+    // used while the call resolves to the function it was made from
+    FuncNode* expected = nullptr;
+    FuncNode* specialized = nullptr;
+    std::vector<size_t> kept;       //arguments that are still passed
+    std::vector<value_bd*> specialized_slots;
+    std::vector<value_bd> specialized_values;
+
+    // builtin the name resolved to when it is not a variable, see call_builtin
+    const Builtin* builtin = nullptr;
+    std::vector<std::string> named;         //variable passed as each argument, empty for other expressions
+    std::vector<value_bd*> pointers;
+
+    void resolve(std::unordered_map<std::string, value_bd>* var_map);
+    value_bd call_builtin(std::unordered_map<std::string, value_bd>* var_map);
+    std::string mutated() const;            //variable a builtin changes in place, empty when none
+
     function_call(std::string n, std::vector<ASTree*> arg): name(n), arguments(arg){}
     ~function_call(){
         for (auto i: arguments){
@@ -139,42 +252,21 @@ struct function_call{
         std::cout << ")";
     }
 
-    value_bd evaluate(std::unordered_map<std::string, value_bd>* var_map){
-        if(var_map->find(name) == var_map->end()){
-            throw EvaluationError("function not found");
-        }
-        value_bd func = (*var_map)[name];
-        if (func.type_tag != "function"){
-            throw EvaluationError("not a function");
-        }
-        FuncNode* myfunc = func.Function_Node;
-        STree* mycode = myfunc->code;
-        std::vector<std::string> myparams = myfunc->parameters;
-        
-        if(myparams.size() != arguments.size()){
-            throw EvaluationError("param size doesnt match");
-        }
-        for(size_t i=0; i<myparams.size(); i++){
-            (*mycode->var_map)[myparams[i]] = arguments[i]->evaluate();
-        }
-        if (mycode){
-            return mycode->evaluate();
-        } else {
-            value_bd null = value_bd();
-            return null;
-        }
-    }
+    value_bd evaluate(std::unordered_map<std::string, value_bd>* var_map);
 };
 
+enum class ExpKind : unsigned char { Expression, Function, FunctionAssigner };
+
 class EXP{ 
 public:
-    std::string type;
+    ExpKind kind;
     ASTree*        expression;
     function_call*   function;
+    std::string      target;    //variable a function_assigner stores to, or the one holding the element it stores to
     std::unordered_map<std::string, value_bd> dummy;
-    EXP(ASTree* e):          type("expression"), expression(e),        function(nullptr){}
-    EXP(function_call* f):   type("function")  , expression(nullptr),  function(f)      {}
-    EXP(std::vector<token> before_func, function_call* f):   type("function_assigner")  , function(f){
+    EXP(ASTree* e):          kind(ExpKind::Expression), expression(e),        function(nullptr){}
+    EXP(function_call* f):   kind(ExpKind::Function), expression(nullptr),  function(f)      {}
+    EXP(std::vector<token> before_func, function_call* f):   kind(ExpKind::FunctionAssigner), function(f){
         if (before_func.size()!=0) {
             int temp_row = before_func.back().row;
             int temp_col = before_func.back().col;
@@ -187,6 +279,18 @@ public:
                 before_func.push_back(end_token);
             }
             expression = new ASTree(before_func, &dummy);
+            set_target();
+        }
+    }
+    EXP(ASTNode* lhs, function_call* f): kind(ExpKind::FunctionAssigner), expression(new ASTree(lhs, &dummy)), function(f){
+        set_target();
+    }
+    // empty when the left side is not assignable, which fails when the statement runs
+    void set_target() {
+        if (IdentifierNode* id = dynamic_cast<IdentifierNode*>(expression->head)) {
+            target = id->name;
+        } else if (IndexNode* element = dynamic_cast<IndexNode*>(expression->head)) {
+            target = element->name;
         }
     }
     ~EXP() {
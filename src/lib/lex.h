@@ -27,7 +27,11 @@ enum class TokenType {
     COMMA,
     SEMI_COLON,
     L_SQUARE,
-    R_SQUARE
+    R_SQUARE,
+    QUESTION,
+    COLON,
+    DOT,
+    RANGE
 };
 
 struct token {
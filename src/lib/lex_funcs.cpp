@@ -141,6 +141,47 @@ std::vector<token> tokenize(const std::string& input) {
                 temp_str_num += in_char;
             }
         }
+        else if (in_char == '.' && stream.peek() == '.') {
+            //a range, 0..n: the number or name before it is finished first
+            if (!temp_str_num.empty()) {
+                all_tokens.push_back(getToken(row, col, temp_str_num, TokenType::NUMBER));
+                col += temp_str_num.length();
+                temp_str_num = "";
+                hasDecimal = false;
+            }
+            else if (!temp_identifier.empty()){
+                if (temp_identifier == "while" || temp_identifier == "if" || temp_identifier == "else" || temp_identifier == "print") {
+                    all_tokens.push_back(getToken(row, col, temp_identifier, TokenType::STATEMENT));
+                } else if (temp_identifier == "true" || temp_identifier == "false") {
+                    all_tokens.push_back(getToken(row, col, temp_identifier, TokenType::BOOLEAN));
+                } else {
+                    all_tokens.push_back(getToken(row, col, temp_identifier, TokenType::VARIABLES));
+                }
+                col += temp_identifier.length();
+                temp_identifier = "";
+                isIdentifier = false;
+            }
+            stream.get();
+            all_tokens.push_back(getToken(row, col, "..", TokenType::RANGE));
+            col += 2;
+        }
+        else if (in_char == '.' && temp_str_num.empty() && (isalpha(stream.peek()) || stream.peek() == '_')) {
+            //a field, p.x: the name before the dot is finished first
+            if (!temp_identifier.empty()){
+                if (temp_identifier == "while" || temp_identifier == "if" || temp_identifier == "else" || temp_identifier == "print") {
+                    all_tokens.push_back(getToken(row, col, temp_identifier, TokenType::STATEMENT));
+                } else if (temp_identifier == "true" || temp_identifier == "false") {
+                    all_tokens.push_back(getToken(row, col, temp_identifier, TokenType::BOOLEAN));
+                } else {
+                    all_tokens.push_back(getToken(row, col, temp_identifier, TokenType::VARIABLES));
+                }
+                col += temp_identifier.length();
+                temp_identifier = "";
+                isIdentifier = false;
+            }
+            all_tokens.push_back(getToken(row, col, string(1, in_char), TokenType::DOT));
+            ++col;
+        }
         else if (in_char == '.') {
             //Checking if decimal point is valid or an error
             if (!isdigit(stream.peek())) {
@@ -184,7 +225,7 @@ std::vector<token> tokenize(const std::string& input) {
             isC_oper = true;
             continue;
         }
-        else if (in_char == ',' || in_char == ';' || in_char == '[' || in_char == ']'){
+        else if (in_char == ',' || in_char == ';' || in_char == '[' || in_char == ']' || in_char == '?' || in_char == ':'){
             if (!temp_str_num.empty()) {
                 all_tokens.push_back(getToken(row, col, temp_str_num, TokenType::NUMBER));
                 col += temp_str_num.length();
@@ -216,6 +257,12 @@ std::vector<token> tokenize(const std::string& input) {
             else if (in_char == ']') {
                 all_tokens.push_back(getToken(row, col, string(1, in_char), TokenType::R_SQUARE));
             }
+            else if (in_char == '?') {
+                all_tokens.push_back(getToken(row, col, string(1, in_char), TokenType::QUESTION));
+            }
+            else if (in_char == ':') {
+                all_tokens.push_back(getToken(row, col, string(1, in_char), TokenType::COLON));
+            }
             ++col;
                 
         }
@@ -2,8 +2,23 @@
 #define VALUE_BD_HPP
 
 #include <string>
+#include <vector>
+#include <memory>
 
 class FuncNode;
+class Dictionary;
+class Heap;
+class Deque;
+struct RecordLayout;
+
+// Elements of an array that all have one type, stored unboxed: numbers as
+// plain doubles, bools one bit each. Copies of the array value and slices of
+// it share it until one of them writes.
+struct PackedArray {
+    bool flags_only;                //bools, otherwise numbers
+    std::vector<double> numbers;
+    std::vector<bool> flags;
+};
 
 struct value_bd{
     std::string type_tag;
@@ -13,6 +28,16 @@ struct value_bd{
     std::string Null;
     std::vector<std::string> array_ele;
     std::vector<value_bd> array;
+    std::shared_ptr<PackedArray> packed;    //when set, holds the elements and array is empty
+    size_t offset = 0;                      //a slice sees extent packed elements from offset on;
+    size_t extent = whole;                  //whole when the value sees all of them
+    size_t columns = 0;                     //a matrix: packed numbers holding its rows one after another
+    std::shared_ptr<Dictionary> dict;       //a dictionary's entries, shared by copies until one writes
+    std::shared_ptr<Heap> heap;             //a heap's entries, shared the same way
+    std::shared_ptr<Deque> deque;           //a deque's elements, shared the same way
+    const RecordLayout* layout = nullptr;   //a record: its fields are array, in the layout's order
+
+    static constexpr size_t whole = (size_t)-1;
 
     
     value_bd() : type_tag("null"), Bool(false), Double(0.0), Function_Node(nullptr),array({}) {}
@@ -27,11 +52,208 @@ struct value_bd{
             Double = value;
         }
     }
-    value_bd(std::string tag, std::string null): type_tag(tag), Null(null){}
-    value_bd(std::string tag, std::vector<value_bd> array): type_tag(tag), array(array){}
-    value_bd(std::string tag, std::vector<value_bd> array, std::vector<std::string> array_str): type_tag(tag), array_ele(array_str), array(array){}
+    value_bd(std::string tag, std::string null): type_tag(tag), Function_Node(nullptr), Null(null){}
+    value_bd(std::string tag, std::vector<value_bd> array): type_tag(tag), Function_Node(nullptr), array(array){}
+    value_bd(std::string tag, std::vector<value_bd> array, std::vector<std::string> array_str): type_tag(tag), Function_Node(nullptr), array_ele(array_str), array(array){}
     value_bd(FuncNode* func_ptr): type_tag("function"), Function_Node(func_ptr){}
 
+    // Element access for array values, whichever way the elements are stored
+    size_t length() const {
+        if (packed != nullptr) {
+            if (extent != whole) {
+                return extent;
+            }
+            return packed->flags_only ? packed->flags.size() : packed->numbers.size();
+        }
+        return array.size();
+    }
+    value_bd at(size_t i) const {
+        if (packed != nullptr) {
+            return packed->flags_only ? value_bd("bool", packed->flags[offset + i]) : value_bd("double", packed->numbers[offset + i]);
+        }
+        return array[i];
+    }
+    double number_at(size_t i) const {
+        if (packed != nullptr && !packed->flags_only) {
+            return packed->numbers[offset + i];
+        }
+        return at(i).Double;
+    }
+    bool flag_at(size_t i) const {
+        if (packed != nullptr && packed->flags_only) {
+            return packed->flags[offset + i];
+        }
+        return at(i).Bool;
+    }
+    std::vector<value_bd> elements() const {
+        if (packed == nullptr) {
+            return array;
+        }
+        std::vector<value_bd> result;
+        if (columns != 0) {
+            for (size_t i = 0; i < rows(); ++i) {
+                result.push_back(row(i));
+            }
+            return result;
+        }
+        result.reserve(length());
+        for (size_t i = 0; i < length(); ++i) {
+            result.push_back(at(i));
+        }
+        return result;
+    }
+
+    // Stores keep the packed form while the type matches; any other value
+    // moves the elements back into array for good. At whole the value itself
+    // is replaced: it is a dictionary entry rather than an array.
+    void store(size_t i, const value_bd& value) {
+        if (i == whole) {
+            *this = value;
+            return;
+        }
+        if (packed != nullptr) {
+            if (value.type_tag == (packed->flags_only ? "bool" : "double")) {
+                unshare();
+                if (packed->flags_only) {
+                    packed->flags[i] = value.Bool;
+                } else {
+                    packed->numbers[i] = value.Double;
+                }
+                return;
+            }
+            unpack();
+        }
+        array[i] = value;
+    }
+    void store(size_t i, double value) {
+        if (i == whole) {
+            *this = value_bd("double", value);
+            return;
+        }
+        if (packed != nullptr && !packed->flags_only) {
+            unshare();
+            packed->numbers[i] = value;
+            return;
+        }
+        store(i, value_bd("double", value));
+    }
+    // Adds an element at the end; an empty array starts packed when the
+    // element is a number or a bool
+    void append(const value_bd& value) {
+        if (packed != nullptr && value.type_tag == (packed->flags_only ? "bool" : "double")) {
+            unshare();
+            if (packed->flags_only) {
+                packed->flags.push_back(value.Bool);
+            } else {
+                packed->numbers.push_back(value.Double);
+            }
+            return;
+        }
+        unpack();
+        array.push_back(value);
+        if (array.size() == 1) {
+            pack();
+        }
+    }
+    value_bd remove_last() {
+        value_bd last = at(length() - 1);
+        if (packed == nullptr) {
+            array.pop_back();
+        } else {
+            unshare();
+            if (packed->flags_only) {
+                packed->flags.pop_back();
+            } else {
+                packed->numbers.pop_back();
+            }
+        }
+        return last;
+    }
+    // The elements from up to but not including to, as a new array value. A
+    // packed array is not copied: the result is a view of the same elements.
+    value_bd range(size_t from, size_t to) const {
+        value_bd result("array", std::vector<value_bd>());
+        if (packed != nullptr) {
+            result.packed = packed;
+            result.offset = offset + from;
+            result.extent = to - from;
+        } else {
+            result.array.assign(array.begin() + from, array.begin() + to);
+            result.pack();
+        }
+        return result;
+    }
+    // For a matrix, length() and at() see all the numbers in order; rows are
+    // counted and read through these
+    size_t rows() const {
+        return length() / columns;
+    }
+    value_bd row(size_t i) const {
+        return range(i * columns, (i + 1) * columns);
+    }
+    // Replaces the elements by packed ones
+    void adopt(std::shared_ptr<PackedArray> storage) {
+        array.clear();
+        packed = storage;
+        offset = 0;
+        extent = whole;
+    }
+    value_bd* element(size_t i) {
+        unpack();
+        return &array[i];
+    }
+
+    // Packs a non-empty array whose elements are all numbers or all bools
+    void pack() {
+        if (type_tag != "array" || packed != nullptr || array.empty()) {
+            return;
+        }
+        const std::string& first = array[0].type_tag;
+        if (first != "double" && first != "bool") {
+            return;
+        }
+        for (const value_bd& item : array) {
+            if (item.type_tag != first) {
+                return;
+            }
+        }
+        std::shared_ptr<PackedArray> storage = std::make_shared<PackedArray>();
+        storage->flags_only = first == "bool";
+        for (const value_bd& item : array) {
+            if (storage->flags_only) {
+                storage->flags.push_back(item.Bool);
+            } else {
+                storage->numbers.push_back(item.Double);
+            }
+        }
+        adopt(storage);
+        array.shrink_to_fit();
+    }
+    void unpack() {
+        if (packed != nullptr) {
+            array = elements();
+            packed = nullptr;
+            offset = 0;
+            extent = whole;
+        }
+    }
+
+    // Makes the packed elements this value's own before they are changed; a
+    // slice gets a copy of just the elements it sees
+    void unshare() {
+        if (extent != whole) {
+            std::shared_ptr<PackedArray> own = std::make_shared<PackedArray>();
+            own->flags_only = packed->flags_only;
+            if (own->flags_only) {
+                own->flags.assign(packed->flags.begin() + offset, packed->flags.begin() + offset + extent);
+            } else {
+                own->numbers.assign(packed->numbers.begin() + offset, packed->numbers.begin() + offset + extent);
+            }
+            adopt(own);
+        } else if (packed.use_count() > 1) {
+            packed = std::make_shared<PackedArray>(*packed);
+        }
+    }
 };
 
 #endif
@@ -1,9 +1,44 @@
 #include "lib/STree.hpp"
+#include "lib/Optimizer.hpp"
+#include "lib/IR.hpp"
 
-int main() {
+int main(int argc, char* argv[]) {
     std::string input;
     std::string error;
     char ch;
+    bool dump = false; //print the optimized tree instead of running it
+    bool dump_ir = false; //print the SSA form of the program instead of running it
+    bool optimize = true;
+    bool stats = false; //report what the optimizer removed on stderr
+    bool types = false; //report what type inference proved on stderr
+    Optimizer::Options options;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--dump") {
+            dump = true;
+        } else if (std::string(argv[i]) == "--dump-ir") {
+            dump_ir = true;
+        } else if (std::string(argv[i]) == "--no-optimize") {
+            optimize = false;
+        } else if (std::string(argv[i]) == "--stats") {
+            stats = true;
+        } else if (std::string(argv[i]) == "--no-inline") {
+            options.inline_functions = false;
+        } else if (std::string(argv[i]).rfind("--inline-size=", 0) == 0) {
+            options.inline_size = std::stoi(std::string(argv[i]).substr(14));
+        } else if (std::string(argv[i]) == "--no-specialize") {
+            options.specialize = false;
+        } else if (std::string(argv[i]) == "--types") {
+            types = true;
+        } else if (std::string(argv[i]) == "--no-types") {
+            options.infer_types = false;
+        } else if (std::string(argv[i]) == "--no-bce") {
+            options.bounds_checks = false;
+        } else if (std::string(argv[i]) == "--no-memo") {
+            options.memoize = false;
+        } else if (std::string(argv[i]).rfind("--memo-size=", 0) == 0) {
+            options.memo_size = std::stoul(std::string(argv[i]).substr(12));
+        }
+    }
     std::unordered_map<std::string, value_bd> var_map;
     //take the entire file as input
     while (std::cin.get(ch)) {
@@ -13,7 +48,51 @@ int main() {
     try{
         std::vector<token> tokens = tokenize(input);
         STree my_tree(tokens, &var_map);
+        if (dump_ir) {
+            IRProgram program(&my_tree);
+            program.propagate_constants();
+            program.dump(std::cout);
+            return 0;
+        }
+        Optimizer optimizer;
+        optimizer.options = options;
+        if (optimize) {
+            optimizer.optimize(&my_tree);
+            if (stats) {
+                std::cerr << "calls inlined: " << optimizer.stats.inlined << std::endl;
+                std::cerr << "functions specialized: " << optimizer.stats.specialized << std::endl;
+                std::cerr << "constants propagated: " << optimizer.stats.constants << std::endl;
+                std::cerr << "unreachable statements removed: " << optimizer.stats.unreachable << std::endl;
+                std::cerr << "dead branch statements removed: " << optimizer.stats.branches << std::endl;
+                std::cerr << "dead stores removed: " << optimizer.stats.dead_stores << std::endl;
+                std::cerr << "bounds checks guarded: " << optimizer.stats.bounds_checks << std::endl;
+            }
+            if (types) {
+                const Optimizer::Stats& typed = optimizer.stats;
+                int proven = typed.typed_double + typed.typed_bool + typed.typed_array;
+                std::cerr << "expressions proven monomorphic: " << proven << " of " << typed.typed;
+                if (typed.typed > 0) {
+                    std::cerr << " (" << 100 * proven / typed.typed << "%)";
+                }
+                std::cerr << std::endl;
+                std::cerr << "number: " << typed.typed_double << ", bool: " << typed.typed_bool << ", array: " << typed.typed_array << std::endl;
+            }
+        }
+        if (dump) {
+            my_tree.print(0);
+            return 0;
+        }
         my_tree.evaluate();
+        if (stats) {
+            for (MemoTable* memo : optimizer.stats.memoized) {
+                unsigned long calls = memo->hits + memo->misses;
+                std::cerr << "memo " << memo->name << ": " << memo->hits << " hits, " << memo->misses << " misses";
+                if (calls != 0) {
+                    std::cerr << " (" << 100.0 * memo->hits / calls << "% hit rate)";
+                }
+                std::cerr << ", " << memo->evictions << " evictions" << std::endl;
+            }
+        }
     } catch (const SyntaxError& e) {
         std::cout << e.what() << std::endl;
         return 1;
@@ -0,0 +1,27 @@
+#!/bin/bash
+# Runs every tests/<group>/<name>.txt through scrypt twice, optimized and with
+# --no-optimize, and compares each run with <name>.expected: the output of the
+# script, errors included, followed by a line with its exit status.
+# usage: tests/run.sh [path to scrypt]
+dir=$(cd "$(dirname "$0")" && pwd)
+scrypt=${1:-$dir/../src/scrypt}
+if [ ! -x "$scrypt" ]; then
+    echo "no scrypt binary at $scrypt"
+    exit 1
+fi
+runs=0
+failed=0
+for input in "$dir"/*/*.txt; do
+    expected=$(cat "${input%.txt}.expected")
+    for mode in "" "--no-optimize"; do
+        actual=$("$scrypt" $mode < "$input" 2>&1; echo "exit $?")
+        runs=$((runs + 1))
+        if [ "$actual" != "$expected" ]; then
+            echo "FAIL ${input#$dir/} ${mode:-(optimized)}"
+            diff <(echo "$expected") <(echo "$actual")
+            failed=$((failed + 1))
+        fi
+    done
+done
+echo "$((runs - failed)) of $runs runs passed"
+[ $failed -eq 0 ]